@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "darray.h"
+#include "pool.h"
+
+// allocation heavy workloads with std::allocator against a SlabResource (pool.h) behind a
+// polymorphic_allocator, each thread on its own ThreadSlabResource():
+//   vectors  bear::vectors of up to 64 ints built by push_back and dropped, so every growth step is a
+//            free and a bigger allocation
+//   map      a std::map of ints with a random insert or erase per op, one node allocation or free each
+// --threads runs that many copies of each workload at once, to show the per-thread resources don't contend.
+// times are per op, summed over threads, best of --runs
+
+using BenchClock = std::chrono::steady_clock;
+
+// splitmix64, so every thread and allocator sees the same sequence
+struct BenchRandom
+{
+    uint64_t state;
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+template <typename Alloc>
+uint64_t Vectors(size_t ops, uint64_t seed, const Alloc& alloc)
+{
+    BenchRandom random{seed};
+    uint64_t sum = 0;
+    std::vector<bear::vector<int, Alloc>> live;
+    for (size_t op = 0; op < ops;)
+    {
+        live.clear(); // a batch of vectors alive at once, so the allocator sees interleaved sizes
+        for (size_t ii = 0; ii < 16 && op < ops; ++ii)
+        {
+            bear::vector<int, Alloc>& vec = live.emplace_back(alloc);
+            size_t count = 1 + random.Next() % 64;
+            for (size_t jj = 0; jj < count; ++jj, ++op)
+                vec.push_back(int(jj));
+            sum += vec.size();
+        }
+    }
+    return sum;
+}
+
+template <typename Alloc>
+uint64_t Map(size_t ops, uint64_t seed, const Alloc& alloc)
+{
+    BenchRandom random{seed};
+    std::map<int, int, std::less<int>, Alloc> map(alloc);
+    for (size_t op = 0; op < ops; ++op)
+    {
+        int key = int(random.Next() % 65536);
+        if (random.Next() % 2)
+            map.emplace(key, key);
+        else
+            map.erase(key);
+    }
+    return map.size();
+}
+
+// ns per op for threads copies of workload run side by side, each building its allocator on its own thread
+template <typename Workload>
+double Run(size_t threads, size_t ops, Workload&& workload)
+{
+    std::vector<std::thread> workers;
+    std::vector<uint64_t> results(threads);
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t tt = 0; tt < threads; ++tt)
+        workers.emplace_back([&, tt] { results[tt] = workload(ops, tt + 1); });
+    for (std::thread& worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+    return seconds * 1e9 / double(ops * threads);
+}
+
+template <typename Workload>
+double Best(size_t runs, size_t threads, size_t ops, Workload&& workload)
+{
+    double best = 0;
+    for (size_t run = 0; run < runs; ++run)
+    {
+        double ns = Run(threads, ops, workload);
+        best = run == 0 ? ns : std::min(best, ns);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    size_t ops = 2000000;
+    size_t threads = 1;
+    size_t runs = 3;
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        std::string arg = argv[ii];
+        if (arg == "--ops" && ii + 1 < argc)
+            ops = std::stoul(argv[++ii]);
+        else if (arg == "--threads" && ii + 1 < argc)
+            threads = std::max<size_t>(1, std::stoul(argv[++ii]));
+        else if (arg == "--runs" && ii + 1 < argc)
+            runs = std::max<size_t>(1, std::stoul(argv[++ii]));
+        else
+        {
+            fprintf(stderr, "usage: %s [--ops N] [--threads N] [--runs N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    using PairAlloc = std::pmr::polymorphic_allocator<std::pair<const int, int>>;
+    printf("ops %zu per thread  threads %zu  best of %zu runs, ns/op\n", ops, threads, runs);
+    printf("%-8s %14s %14s\n", "", "std::allocator", "thread slab");
+    double stdVectors = Best(runs, threads, ops, [](size_t n, uint64_t seed) { return Vectors(n, seed, std::allocator<int>()); });
+    double slabVectors = Best(runs, threads, ops, [](size_t n, uint64_t seed)
+                              { return Vectors(n, seed, std::pmr::polymorphic_allocator<int>(&ThreadSlabResource())); });
+    printf("%-8s %14.2f %14.2f\n", "vectors", stdVectors, slabVectors);
+    double stdMap = Best(runs, threads, ops, [](size_t n, uint64_t seed)
+                         { return Map(n, seed, std::allocator<std::pair<const int, int>>()); });
+    double slabMap = Best(runs, threads, ops, [](size_t n, uint64_t seed) { return Map(n, seed, PairAlloc(&ThreadSlabResource())); });
+    printf("%-8s %14.2f %14.2f\n", "map", stdMap, slabMap);
+}
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "command.h"
+#include "flowgen.h"
+#include "journal.h"
+#include "market.h"
+#include "sink.h"
+
+// in-process Market benchmark over a synthetic flow (see flowgen.h). the whole flow is generated up front,
+// then run through a fresh Market --runs times for throughput, and once more timing every message on its
+// own for the latency percentiles. the clock reads cost a few tens of ns each, so the latencies are only
+// comparable with each other, and the throughput runs don't take them. output goes to a NullSink, or is
+// formatted into a BufferedSink on /dev/null with --text. the NullSink one is a NullMarket, with the
+// output calls compiled out, unless --virtual-sink keeps them as calls through EventSink. --journal adds the write-ahead journal, committed
+// every --group commands the way trade commits once per input run. --batch hands the throughput
+// runs' commands to Market::ProcessBatch that many at a time, to see whether it pays for trade to use it.
+
+using BenchClock = std::chrono::steady_clock;
+
+double Seconds(BenchClock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+int main(int argc, char** argv)
+{
+    FlowConfig flow;
+    MarketConfig config;
+    size_t runs = 3;
+    bool text = false;
+    bool virtualSink = false;
+    JournalConfig journalConfig;
+    size_t group = 1024;
+    size_t batch = 0; // Process one command at a time
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        std::string arg = argv[ii];
+        if (ParseFlowOption(argc, argv, ii, flow))
+            continue;
+        if (arg == "--runs" && ii + 1 < argc)
+            runs = std::stoul(argv[++ii]);
+        else if (arg == "--ladder" && ii + 1 < argc)
+            config.ladderBand = std::stoul(argv[++ii]);
+        else if (arg == "--reserve" && ii + 1 < argc)
+            config.reserveOrders = std::stoul(argv[++ii]);
+        else if (arg == "--hashed-ids")
+            config.directIds = false;
+        else if (arg == "--amend")
+            config.amendInPlace = true;
+        else if (arg == "--text")
+            text = true;
+        else if (arg == "--virtual-sink")
+            virtualSink = true;
+        else if (arg == "--journal" && ii + 1 < argc)
+            journalConfig.dir = argv[++ii];
+        else if (arg == "--journal-sync" && ii + 1 < argc && ParseJournalSync(argv[ii + 1], journalConfig.sync))
+            ++ii;
+        else if (arg == "--group" && ii + 1 < argc)
+            group = std::max<size_t>(1, std::stoul(argv[++ii]));
+        else if (arg == "--batch" && ii + 1 < argc)
+            batch = std::stoul(argv[++ii]);
+        else
+        {
+            fprintf(stderr, "usage: %s %s\n"
+                            "          [--runs N] [--ladder TICKS] [--reserve ORDERS] [--hashed-ids] [--amend] [--text | --virtual-sink]\n"
+                            "          [--batch COMMANDS] [--journal DIR [--journal-sync none|batch|every] [--group COMMANDS]]\n", argv[0], FLOW_USAGE);
+            return 1;
+        }
+    }
+    if (!CheckFlowConfig(flow) || flow.symbols)
+    {
+        fprintf(stderr, "add + cancel + revise and immediate must each be at most 100, band and max qty at least 1, and no --symbols\n");
+        return 1;
+    }
+    int devNull = open("/dev/null", O_WRONLY);
+
+    std::vector<Command> commands;
+    commands.reserve(flow.messages);
+    FlowGenerator generator(flow);
+    for (Command cmd; generator.Next(cmd);)
+        commands.push_back(cmd);
+
+    printf("messages %zu  seed %llu  band %d  depth %zu  add/cancel/revise/aggressive %u/%u/%u/%u  ladder %zu%s%s%s",
+           commands.size(), (unsigned long long)flow.seed, flow.band, flow.depth, flow.addPercent, flow.cancelPercent,
+           flow.revisePercent, 100 - flow.addPercent - flow.cancelPercent - flow.revisePercent, config.ladderBand,
+           config.directIds ? "" : "  hashed ids", config.amendInPlace ? "  amend" : "",
+           text ? "  text output" : virtualSink ? "  virtual sink" : "");
+    if (flow.immediatePercent)
+        printf("  immediate %u%%", flow.immediatePercent);
+    if (batch)
+        printf("  batches of %zu", batch);
+    printf("\n");
+    bool journaled = !journalConfig.dir.empty();
+    if (journaled)
+    {
+        static constexpr const char* SYNC_NAMES[] = {"none", "batch", "every"};
+        printf("journal %s  sync %s  commit every %zu commands\n", journalConfig.dir.c_str(),
+               SYNC_NAMES[int(journalConfig.sync)], group);
+    }
+    // each pass starts the journal over at sequence 0, overwriting the last pass's segments
+    auto makeJournal = [&] { return journaled ? std::make_unique<Journal>(journalConfig, 0) : nullptr; };
+
+    // fn(market, sink) with a fresh Market of the kind the options ask for
+    auto withMarket = [&](auto&& fn)
+    {
+        if (text)
+        {
+            BufferedSink sink(devNull);
+            Market market(sink, config);
+            fn(market, sink);
+        }
+        else if (virtualSink)
+        {
+            NullSink sink;
+            Market market(sink, config);
+            fn(market, sink);
+        }
+        else
+        {
+            NullSink sink;
+            NullMarket market(sink, config);
+            fn(market, sink);
+        }
+    };
+
+    std::vector<double> rates;
+    for (size_t run = 0; run < runs; ++run)
+    {
+        withMarket([&](auto& market, EventSink& sink)
+                   {
+                       std::unique_ptr<Journal> journal = makeJournal();
+                       BenchClock::time_point start = BenchClock::now();
+                       size_t step = std::max<size_t>(1, batch);
+                       for (size_t ii = 0; ii < commands.size(); ii += step)
+                       {
+                           size_t count = std::min(step, commands.size() - ii);
+                           if (journal)
+                           {
+                               for (size_t jj = ii; jj < ii + count; ++jj)
+                                   journal->Append(commands[jj]);
+                           }
+                           if (batch)
+                               market.ProcessBatch(std::span<const Command>(commands.data() + ii, count));
+                           else
+                               market.Process(commands[ii]);
+                           if (journal && (ii + count) / group != ii / group)
+                               journal->Commit();
+                       }
+                       if (journal)
+                           journal->Commit();
+                       sink.Flush();
+                       double seconds = Seconds(BenchClock::now() - start);
+                       rates.push_back(double(commands.size()) / seconds);
+                       printf("run %zu: %.3f s  %.2f M msg/s\n", run + 1, seconds, rates.back() / 1e6);
+                   });
+    }
+    if (!rates.empty())
+    {
+        std::sort(rates.begin(), rates.end());
+        printf("throughput: best %.2f M msg/s  median %.2f M msg/s\n", rates.back() / 1e6, rates[rates.size() / 2] / 1e6);
+    }
+
+    std::vector<uint32_t> latencies(commands.size());
+    withMarket([&](auto& market, EventSink& sink)
+               {
+                   std::unique_ptr<Journal> journal = makeJournal();
+                   for (size_t ii = 0; ii < commands.size(); ++ii)
+                   {
+                       BenchClock::time_point start = BenchClock::now();
+                       if (journal)
+                           journal->Append(commands[ii]);
+                       market.Process(commands[ii]);
+                       if (journal && (ii + 1) % group == 0)
+                           journal->Commit(); // lands on whichever command closes the group, like it would in trade
+                       auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+                       latencies[ii] = uint32_t(std::min<int64_t>(ns, UINT32_MAX));
+                   }
+                   sink.Flush();
+               });
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&](double q) { return latencies[std::min(latencies.size() - 1, size_t(q * double(latencies.size())))]; };
+        printf("latency ns: p50 %u  p90 %u  p99 %u  p99.9 %u  p99.99 %u  max %u\n", at(0.5), at(0.9), at(0.99), at(0.999),
+               at(0.9999), latencies.back());
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// one decoded input message, see the input format at the top of main.cpp
+
+enum class CommandType : uint8_t
+{
+    Buy,
+    Sell,
+    Revise,
+    Cancel,
+    Depth, // top of book request, orderId is the request id and qty the number of levels per side
+    IocBuy, // the immediate orders, which trade what they can and never rest. see ImmediateKind
+    IocSell,
+    FokBuy,
+    FokSell,
+    MarketBuy, // price is unused
+    MarketSell,
+    Stats, // engine stats request, orderId is the request id
+    Invalid, // unknown command word, answered with "could not parse command"
+    None, // nothing but whitespace left in the buffer
+    Stop, // an order id which isn't a number or doesn't fit. ends the input here, like a failed std::cin read did
+};
+
+struct Command
+{
+    uint64_t orderId;
+    int32_t qty;
+    int32_t price;
+    CommandType type;
+    std::string_view symbol; // empty if the line didn't name one. points into the input, only valid while parsing
+};
+
+// IOC fills what it can within its price and cancels the rest, FOK fills completely within its price or not
+// at all, and MARKET is an IOC without a price limit
+enum class ImmediateKind : uint8_t
+{
+    Ioc,
+    Fok,
+    Market,
+};
+
+inline bool IsImmediate(CommandType type) { return type >= CommandType::IocBuy && type <= CommandType::MarketSell; }
+
+// type must be one of the immediate ones. they come in buy, sell pairs in ImmediateKind order
+inline ImmediateKind ImmediateKindOf(CommandType type) { return ImmediateKind((uint8_t(type) - uint8_t(CommandType::IocBuy)) / 2); }
+inline bool ImmediateIsBuy(CommandType type) { return (uint8_t(type) - uint8_t(CommandType::IocBuy)) % 2 == 0; }
+
+inline CommandType ImmediateType(ImmediateKind kind, bool isBuy)
+{
+    return CommandType(uint8_t(CommandType::IocBuy) + uint8_t(kind) * 2 + (isBuy ? 0 : 1));
+}
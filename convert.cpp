@@ -0,0 +1,264 @@
+#include <charconv>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+#include "flowgen.h"
+#include "protocol.h"
+#include "reader.h"
+#include "sink.h"
+
+// translates between the text protocol and the binary one from protocol.h:
+//   convert to-binary [--events] <in> <out>   text commands (like test1.txt), or trade's text output with --events
+//   convert to-text <in> <out>                either kind of binary file, told apart by its header
+// "-" is stdin/stdout
+
+template <typename Record>
+class RecordWriter
+{
+public:
+    RecordWriter(int fd, BinaryKind kind)
+        : _fd(fd)
+    {
+        BinaryFileHeader header = MakeBinaryHeader<Record>(kind);
+        WriteAll(_fd, reinterpret_cast<const char*>(&header), sizeof(header));
+        _records.reserve(OUTPUT_BUFFER_BYTES / sizeof(Record));
+    }
+
+    ~RecordWriter() { Flush(); }
+
+    void Put(const Record& record)
+    {
+        if (_records.size() == _records.capacity())
+            Flush();
+        _records.push_back(record);
+    }
+
+    void Flush()
+    {
+        WriteAll(_fd, reinterpret_cast<const char*>(_records.data()), _records.size() * sizeof(Record));
+        _records.clear();
+    }
+
+private:
+    int _fd;
+    std::vector<Record> _records;
+};
+
+void CommandsToBinary(InputReader& reader, int outFd)
+{
+    RecordWriter<BinaryCommand> writer(outFd, BinaryKind::Commands);
+    ReadText(reader, [&](const Command& cmd) { writer.Put(EncodeCommand(cmd)); }, [] {}); // stops where trade would
+}
+
+// one line of trade's text output, false if it isn't one
+bool ParseEvent(const char* p, const char* end, BinaryEvent& record)
+{
+    record = BinaryEvent();
+    const char* word = SkipSpace(p, end);
+    p = word;
+    while (p < end && !IsSpace(*p))
+        ++p;
+    std::string_view type(word, size_t(p - word));
+
+    auto next = [&](auto& value)
+    {
+        p = SkipSpace(p, end);
+        auto [ptr, ec] = std::from_chars(p, end, value);
+        p = ptr;
+        return ec == std::errc();
+    };
+    if (type == "BUY" || type == "SELL" || type == "REVISE")
+    {
+        record.type = uint8_t(type == "BUY" ? BinaryEventType::Buy : type == "SELL" ? BinaryEventType::Sell : BinaryEventType::Revise);
+        return next(record.qty) && next(record.price) && next(record.orderId);
+    }
+    if (type == "CANCEL")
+    {
+        record.type = uint8_t(BinaryEventType::Cancel);
+        return next(record.orderId) && next(record.qty);
+    }
+    if (type == "TRADE")
+    {
+        record.type = uint8_t(BinaryEventType::Trade);
+        return next(record.orderId) && next(record.passiveId) && next(record.qty) && next(record.price);
+    }
+    if (type == "DEPTH" || type == "LEVEL")
+    {
+        p = SkipSpace(p, end);
+        bool isBuy = end - p >= 3 && std::memcmp(p, "BID", 3) == 0;
+        if (!isBuy && !(end - p >= 3 && std::memcmp(p, "ASK", 3) == 0))
+            return false;
+        p += 3;
+        if (type == "DEPTH")
+            record.type = uint8_t(isBuy ? BinaryEventType::DepthBid : BinaryEventType::DepthAsk);
+        else
+            record.type = uint8_t(isBuy ? BinaryEventType::BookBid : BinaryEventType::BookAsk);
+        return next(record.price) && next(record.orderId) && next(record.passiveId);
+    }
+    if (type == "IOC" || type == "FOK" || type == "MARKET")
+    {
+        ImmediateKind kind = type == "IOC" ? ImmediateKind::Ioc : type == "FOK" ? ImmediateKind::Fok : ImmediateKind::Market;
+        p = SkipSpace(p, end);
+        bool isBuy = end - p >= 3 && std::memcmp(p, "BUY", 3) == 0;
+        if (!isBuy && !(end - p >= 4 && std::memcmp(p, "SELL", 4) == 0))
+            return false;
+        p += isBuy ? 3 : 4;
+        record.type = uint8_t(ImmediateEventType(kind, isBuy));
+        return next(record.qty) && (kind == ImmediateKind::Market || next(record.price)) && next(record.orderId);
+    }
+    if (type == "BOOK")
+    {
+        record.type = uint8_t(BinaryEventType::Book);
+        return next(record.orderId) && next(record.passiveId) && next(record.qty);
+    }
+    if (type == "STATS")
+    {
+        record.type = uint8_t(BinaryEventType::Stats);
+        return next(record.orderId) && next(record.qty);
+    }
+    if (type == "STAT")
+    {
+        const char* name = p = SkipSpace(p, end);
+        while (p < end && !IsSpace(*p))
+            ++p;
+        StatId stat;
+        if (!ParseStatName(std::string_view(name, size_t(p - name)), stat))
+            return false;
+        record.type = uint8_t(BinaryEventType::Stat);
+        record.passiveId = uint64_t(stat);
+        return next(record.orderId);
+    }
+    record.type = uint8_t(BinaryEventType::ParseError);
+    return std::string_view(word, size_t(end - word)).starts_with("could not parse command");
+}
+
+bool EventsToBinary(InputReader& reader, int outFd)
+{
+    RecordWriter<BinaryEvent> writer(outFd, BinaryKind::Events);
+    const char* begin;
+    const char* end;
+    size_t lineNum = 0;
+    while (reader.next(begin, end))
+    {
+        for (const char* line = begin; line < end;)
+        {
+            const char* lineEnd = SkipLine(line, end);
+            ++lineNum;
+            if (SkipSpace(line, lineEnd) != lineEnd)
+            {
+                BinaryEvent record;
+                if (!ParseEvent(line, lineEnd, record))
+                {
+                    fprintf(stderr, "line %zu is not an output message\n", lineNum);
+                    return false;
+                }
+                writer.Put(record);
+            }
+            line = lineEnd;
+        }
+    }
+    return true;
+}
+
+void CommandsToText(InputReader& reader, int outFd)
+{
+    std::vector<char> buffer(OUTPUT_BUFFER_BYTES);
+    const char* begin;
+    const char* end;
+    while (reader.nextRecords(begin, end, sizeof(BinaryCommand)))
+    {
+        char* out = buffer.data();
+        for (const char* p = begin; p + sizeof(BinaryCommand) <= end; p += sizeof(BinaryCommand))
+        {
+            if (size_t(buffer.data() + buffer.size() - out) < MAX_COMMAND_BYTES)
+            {
+                WriteAll(outFd, buffer.data(), size_t(out - buffer.data()));
+                out = buffer.data();
+            }
+            BinaryCommand record;
+            std::memcpy(&record, p, sizeof(record));
+            Command cmd = DecodeCommand(record);
+            out = FormatCommand(out, cmd);
+            *out++ = '\n';
+        }
+        WriteAll(outFd, buffer.data(), size_t(out - buffer.data()));
+    }
+}
+
+void EventsToText(InputReader& reader, int outFd)
+{
+    BufferedSink sink(outFd);
+    const char* begin;
+    const char* end;
+    while (reader.nextRecords(begin, end, sizeof(BinaryEvent)))
+    {
+        for (const char* p = begin; p + sizeof(BinaryEvent) <= end; p += sizeof(BinaryEvent))
+        {
+            BinaryEvent record;
+            std::memcpy(&record, p, sizeof(record));
+            DispatchEvent(record, sink);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    bool events = false;
+    if (args.size() == 4 && args[1] == "--events")
+    {
+        events = true;
+        args.erase(args.begin() + 1);
+    }
+    if (args.size() != 3 || (args[0] != "to-binary" && args[0] != "to-text") || (events && args[0] != "to-binary"))
+    {
+        fprintf(stderr, "usage: %s to-binary [--events] <in> <out>\n"
+                        "       %s to-text <in> <out>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int inFd = args[1] == "-" ? STDIN_FILENO : open(args[1].c_str(), O_RDONLY);
+    if (inFd < 0)
+    {
+        perror(args[1].c_str());
+        return 1;
+    }
+    int outFd = args[2] == "-" ? STDOUT_FILENO : open(args[2].c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd < 0)
+    {
+        perror(args[2].c_str());
+        return 1;
+    }
+
+    InputReader reader(inFd);
+    if (args[0] == "to-binary")
+    {
+        if (!events)
+            CommandsToBinary(reader, outFd);
+        else if (!EventsToBinary(reader, outFd))
+            return 1;
+        return 0;
+    }
+
+    BinaryFileHeader header;
+    if (!reader.take(&header, sizeof(header)))
+    {
+        fprintf(stderr, "%s: too short for a binary file\n", args[1].c_str());
+        return 1;
+    }
+    if (CheckBinaryHeader<BinaryCommand>(header, BinaryKind::Commands))
+        CommandsToText(reader, outFd);
+    else if (CheckBinaryHeader<BinaryEvent>(header, BinaryKind::Events))
+        EventsToText(reader, outFd);
+    else
+    {
+        fprintf(stderr, "%s: not a version %u binary file\n", args[1].c_str(), unsigned(BINARY_VERSION));
+        return 1;
+    }
+    return 0;
+}
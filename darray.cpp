@@ -1,5 +1,6 @@
 #include "darray.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <string>
@@ -72,5 +73,28 @@ int main()
     printf("move assign other = cubs\n");
     otherCubs = std::move(cubs);
 
+    printf("emplace_back bear, insert first at the front, erase the second\n");
+    otherCubs.emplace_back("bear", 7, 30);
+    otherCubs.insert(otherCubs.begin(), Cub("first", 3, 5));
+    otherCubs.erase(otherCubs.begin() + 1);
+    for (auto it = otherCubs.rbegin(); it != otherCubs.rend(); ++it)
+        printf("backwards: %s\n", it->name.c_str());
+
+    printf("ints grow with memcpy, and the std algorithms take the iterators\n");
+    bear::vector<int> numbers = {5, 3, 1};
+    numbers.insert(numbers.end(), {4, 2});
+    std::sort(numbers.begin(), numbers.end());
+    for (int number : numbers)
+        printf("%d ", number);
+    printf("\n");
+
+    printf("small_vector keeps its first 2 cubs inline, the third goes to the heap\n");
+    bear::small_vector<Cub, 2> litter;
+    litter.emplace_back("one", 1, 1);
+    litter.emplace_back("two", 2, 2);
+    printf("inline capacity %zu\n", litter.capacity());
+    litter.emplace_back("three", 3, 3);
+    printf("spilled capacity %zu\n", litter.capacity());
+
     return otherCubs.size();
 }
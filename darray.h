@@ -1,48 +1,109 @@
 #pragma once
 
-#include <memory>
+#include <algorithm>
+#include <compare>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 // refer to: https://github.com/nbird11/vector-cpp-stl
 
 namespace bear
 {
 
-template <typename T, typename A = std::allocator<T>>
-class vector
+// whether a T can be moved to another address by copying its bytes and forgetting the original, without
+// running its move constructor and destructor. true for trivially copyable types, specialize it for
+// others which are (most types which don't point into themselves, like std::unique_ptr)
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T>
 {
-public:
-    vector(const A& alloc = A());
-    explicit vector(size_t count, const A& alloc = A());
-    explicit vector(size_t count, const T& value = T(), const A& alloc = A());
-
-    vector(const vector& rhs);
-    vector(vector&& rhs);
-
-    ~vector() noexcept;
+};
 
-    void swap(vector<T, A>& rhs)
-    {
-	std::swap(_start, rhs._start);
-	std::swap(_numElems, rhs._numElems);
-	std::swap(_numCapacity, rhs._numCapacity);
-	std::swap(_alloc, rhs._alloc);
-    }
+// elements live in the first InlineCount slots of the object itself until there are more than that, and
+// only then in memory from A. bear::vector is the InlineCount = 0 case and never holds any inline.
+// allocators follow std::allocator_traits like the std containers do: a copy gets
+// select_on_container_copy_construction's allocator, and assignment and swap only hand the allocator
+// over if its propagate_on_container_* trait says so. otherwise memory never moves between unequal
+// allocators, the elements are moved one by one instead (and swapping unequal ones is undefined, as in std)
+template <typename T, typename A, size_t InlineCount>
+class basic_vector
+{
+public:
+    using value_type = T;
+    using allocator_type = A;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using pointer = T*;
+    using const_pointer = const T*;
+
+    template <typename U>
+    class basic_iterator;
+    using iterator = basic_iterator<T>;
+    using const_iterator = basic_iterator<const T>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    basic_vector(const A& alloc = A());
+    explicit basic_vector(size_t count, const A& alloc = A());
+    basic_vector(size_t count, const T& value, const A& alloc = A());
+    basic_vector(std::initializer_list<T> init, const A& alloc = A());
+
+    basic_vector(const basic_vector& rhs);
+    basic_vector(const basic_vector& rhs, const A& alloc);
+    // moving inline elements moves each of them, so that only can't throw if T's move can't
+    basic_vector(basic_vector&& rhs) noexcept(InlineCount == 0 || std::is_nothrow_move_constructible_v<T>);
+    basic_vector(basic_vector&& rhs, const A& alloc);
+
+    ~basic_vector() noexcept;
+
+    void swap(basic_vector& rhs);
 
     size_t capacity() const { return _numCapacity; }
     size_t size() const { return _numElems; }
-    size_t empty() const { return _numElems == 0; }
+    bool empty() const { return _numElems == 0; }
+    A get_allocator() const { return _alloc; }
 
     void reserve(size_t newCap);
     void resize(size_t newCap);
     void resize(size_t newCap, const T& value);
-    void push_back(const T& value);
-    void push_back(T&& value);
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+    template <typename... Args>
+    T& emplace_back(Args&&... args);
+
+    // the inserts append and then rotate the new elements into place, so they cost what a push_back does
+    // plus moving everything after pos along
+    template <typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args);
+    iterator insert(const_iterator pos, const T& value) { return emplace(pos, value); }
+    iterator insert(const_iterator pos, T&& value) { return emplace(pos, std::move(value)); }
+    iterator insert(const_iterator pos, size_t count, const T& value);
+    template <std::input_iterator It>
+    iterator insert(const_iterator pos, It first, It last); // [first, last) mustn't be in this vector
+    iterator insert(const_iterator pos, std::initializer_list<T> init) { return insert(pos, init.begin(), init.end()); }
+
+    iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+    iterator erase(const_iterator first, const_iterator last);
+
+    void assign(size_t count, const T& value);
+    template <std::input_iterator It>
+    void assign(It first, It last)
+    {
+        clear();
+        insert(cend(), first, last);
+    }
+    void assign(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
 
     void clear() // does not deallocate, just destructs elements and reduces size to 0
     {
-        for (int64_t ii = int64_t(size()) - 1; ii >= 0; --ii)
-            std::allocator_traits<A>::destroy(_alloc, _start + ii);
+        destroy(0, _numElems);
         _numElems = 0;
     }
     void pop_back();
@@ -50,283 +111,580 @@ public:
 
     T& operator[](size_t index);
     const T& operator[](size_t index) const;
+    T& front() { return _start[0]; }
+    const T& front() const { return _start[0]; }
+    T& back() { return _start[_numElems - 1]; }
+    const T& back() const { return _start[_numElems - 1]; }
+    T* data() { return _start; }
+    const T* data() const { return _start; }
 
-    vector& operator=(vector rhs); // copy-and-swap idiom for strong exception safety
+    basic_vector& operator=(const basic_vector& rhs);
+    basic_vector& operator=(basic_vector&& rhs);
 
-    class iterator;
     iterator begin() { return iterator(_start); }
     iterator end() { return iterator(_start + _numElems); }
+    const_iterator begin() const { return const_iterator(_start); }
+    const_iterator end() const { return const_iterator(_start + _numElems); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    const_reverse_iterator crbegin() const { return rbegin(); }
+    const_reverse_iterator crend() const { return rend(); }
 
 private:
-    A _alloc;
+    using Traits = std::allocator_traits<A>;
+    static constexpr bool PROPAGATE_ON_COPY = Traits::propagate_on_container_copy_assignment::value;
+    static constexpr bool PROPAGATE_ON_MOVE = Traits::propagate_on_container_move_assignment::value;
+    static constexpr bool PROPAGATE_ON_SWAP = Traits::propagate_on_container_swap::value;
+
+    size_t grownCapacity(size_t needed) const { return std::max(needed, _numCapacity == 0 ? 1 : _numCapacity * 2); }
+    void destroy(size_t from, size_t to) noexcept; // back to front, like the elements' lifetimes
+    void reallocate(size_t newCapacity);
+    static void relocate(A& alloc, T* dest, T* src, size_t count);
+
+    T* inlineData()
+    {
+        if constexpr (InlineCount > 0)
+            return reinterpret_cast<T*>(_inline.bytes);
+        else
+            return nullptr;
+    }
+    bool isInline() const { return InlineCount > 0 && _start == reinterpret_cast<const T*>(&_inline); }
+    // gives back the buffer if it came from A, leaving the (empty) vector on its inline slots
+    void release() noexcept;
+    // takes rhs's elements and buffer (or moves its inline elements over), leaving rhs empty and inline.
+    // *this must be empty and on its inline slots, and rhs's buffer must be one our allocator can free
+    void take(basic_vector& rhs);
+
+    struct InlineSlots
+    {
+        alignas(T) unsigned char bytes[InlineCount * sizeof(T)];
+    };
+    struct NoSlots
+    {
+    };
+
+    [[no_unique_address]] A _alloc;
     T* _start;
     size_t _numElems;
     size_t _numCapacity;
+    [[no_unique_address]] std::conditional_t<InlineCount == 0, NoSlots, InlineSlots> _inline;
 };
 
-template <typename T, typename A>
-class vector<T, A>::iterator
+template <typename T, typename A = std::allocator<T>>
+using vector = basic_vector<T, A, 0>;
+
+// N elements inline, e.g. for containers which are almost always short
+template <typename T, size_t N, typename A = std::allocator<T>>
+using small_vector = basic_vector<T, A, N>;
+
+// contiguous, so std algorithms see plain memory and can vectorize over it
+template <typename T, typename A, size_t InlineCount>
+template <typename U>
+class basic_vector<T, A, InlineCount>::basic_iterator
 {
 public:
-    iterator() : _ptr(nullptr) {}
-    iterator(T* ptr) : _ptr(ptr) {}
-    iterator(const iterator& rhs) : _ptr(rhs._ptr) {}
-
-    iterator& operator=(const iterator& rhs)
+    using iterator_concept = std::contiguous_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::remove_cv_t<U>;
+    using element_type = U;
+    using difference_type = std::ptrdiff_t;
+    using pointer = U*;
+    using reference = U&;
+
+    basic_iterator() : _ptr(nullptr) {}
+    basic_iterator(U* ptr) : _ptr(ptr) {}
+
+    // iterator converts to const_iterator
+    template <typename V>
+        requires std::is_same_v<const V, U>
+    basic_iterator(const basic_iterator<V>& rhs) : _ptr(rhs.operator->()) {}
+
+    U& operator*() const { return *_ptr; }
+    U* operator->() const { return _ptr; }
+    U& operator[](difference_type n) const { return _ptr[n]; }
+
+    bool operator==(const basic_iterator& rhs) const { return _ptr == rhs._ptr; }
+    std::strong_ordering operator<=>(const basic_iterator& rhs) const { return _ptr <=> rhs._ptr; }
+
+    basic_iterator& operator++()
     {
-	_ptr = rhs._ptr;
-	return *this;
+        _ptr++;
+        return *this;
     }
 
-    bool operator==(const iterator& rhs) const { return _ptr == rhs._ptr; }
-    bool operator!=(const iterator& rhs) const { return _ptr != rhs._ptr; }
-
-    T& operator*() { return *_ptr; }
+    basic_iterator operator++(int)
+    {
+        basic_iterator tmp(_ptr);
+        _ptr++;
+        return tmp;
+    }
 
-    iterator& operator++()
+    basic_iterator& operator--()
     {
-	_ptr++;
-	return *this;
+        _ptr--;
+        return *this;
     }
 
-    iterator operator++(int postfix)
+    basic_iterator operator--(int)
     {
-	iterator tmp(_ptr);
-	_ptr++;
-	return tmp;
+        basic_iterator tmp(_ptr);
+        _ptr--;
+        return tmp;
     }
 
-    iterator& operator--()
+    basic_iterator& operator+=(difference_type n)
     {
-	_ptr--;
-	return *this;
+        _ptr += n;
+        return *this;
     }
 
-    iterator operator--(int postfix)
+    basic_iterator& operator-=(difference_type n)
     {
-	iterator tmp(_ptr);
-	_ptr--;
-	return tmp;
+        _ptr -= n;
+        return *this;
     }
+
+    friend basic_iterator operator+(basic_iterator it, difference_type n) { return it += n; }
+    friend basic_iterator operator+(difference_type n, basic_iterator it) { return it += n; }
+    friend basic_iterator operator-(basic_iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const basic_iterator& lhs, const basic_iterator& rhs) { return lhs._ptr - rhs._ptr; }
+
 private:
-    T* _ptr;
+    U* _ptr;
 };
 
-template <typename T, typename A>
-vector<T, A>::vector(const A& alloc)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(const A& alloc)
+    : _alloc(alloc)
 {
-    _alloc = alloc;
-    _start = nullptr;
+    _start = inlineData();
     _numElems = 0;
-    _numCapacity = 0;
+    _numCapacity = InlineCount;
 }
 
-template <typename T, typename A>
-vector<T, A>::vector(size_t count, const A& alloc)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(size_t count, const A& alloc)
+    : basic_vector(alloc)
 {
-    _alloc = alloc;
-    _numElems = count;
-    _numCapacity = count;
-    _start = _alloc.allocate(count);
-    for (size_t ii = 0; ii < _numElems; ++ii)
-	std::allocator_traits<A>::construct(_alloc, _start + ii);
+    resize(count);
 }
 
-template <typename T, typename A>
-vector<T, A>::vector(size_t count, const T& value, const A& alloc)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(size_t count, const T& value, const A& alloc)
+    : basic_vector(alloc)
 {
-    _alloc = alloc;
-    _numElems = count;
-    _numCapacity = count;
-    _start = _alloc.allocate(count);
-    for (size_t ii = 0; ii < _numElems; ++ii)
-	std::allocator_traits<A>::construct(_alloc, _start + ii, value);
+    resize(count, value);
 }
 
-template <typename T, typename A>
-vector<T, A>::vector(const vector& rhs)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(std::initializer_list<T> init, const A& alloc)
+    : basic_vector(alloc)
 {
-    if (!rhs.empty())
-    {
-        _start = _alloc.allocate(rhs._numElems);
-        _numCapacity = rhs._numCapacity;
-        _numElems = rhs._numElems;
-        for (size_t ii = 0; ii < _numElems; ++ii)
-            std::allocator_traits<A>::construct(_alloc, _start + ii, rhs._start[ii]);
-    }
+    insert(cend(), init.begin(), init.end());
+}
+
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(const basic_vector& rhs)
+    : basic_vector(Traits::select_on_container_copy_construction(rhs._alloc))
+{
+    insert(cend(), rhs.begin(), rhs.end());
+}
+
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(const basic_vector& rhs, const A& alloc)
+    : basic_vector(alloc)
+{
+    insert(cend(), rhs.begin(), rhs.end());
+}
+
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(basic_vector&& rhs) noexcept(InlineCount == 0 || std::is_nothrow_move_constructible_v<T>)
+    : _alloc(rhs._alloc) // copied rather than moved, rhs may allocate again
+{
+    _start = inlineData();
+    _numElems = 0;
+    _numCapacity = InlineCount;
+    take(rhs);
+}
+
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::basic_vector(basic_vector&& rhs, const A& alloc)
+    : basic_vector(alloc)
+{
+    if (Traits::is_always_equal::value || _alloc == rhs._alloc)
+        take(rhs);
     else
     {
-        _start = nullptr;
-        _numElems = 0;
-        _numCapacity = 0;
+        insert(cend(), std::make_move_iterator(rhs.begin()), std::make_move_iterator(rhs.end()));
+        rhs.clear();
     }
 }
 
-template <typename T, typename A>
-vector<T, A>::vector(vector&& rhs)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>::~basic_vector() noexcept
+{
+    destroy(0, _numElems); // destructors nothrow as required by our and STL's API
+    release();
+}
+
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::release() noexcept
+{
+    if (_start && !isInline())
+        Traits::deallocate(_alloc, _start, _numCapacity); // the std::allocator doesn't need the capacity, but others might
+    _start = inlineData();
+    _numCapacity = InlineCount;
+}
+
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::take(basic_vector& rhs)
 {
-    // should be nothrow even if type T can throw on move
+    if (rhs.isInline())
+    {
+        relocate(_alloc, _start, rhs._start, rhs._numElems);
+        _numElems = rhs._numElems;
+        rhs._numElems = 0;
+        return;
+    }
     _start = rhs._start;
-    rhs._start = nullptr;
     _numElems = rhs._numElems;
-    rhs._numElems = 0;
     _numCapacity = rhs._numCapacity;
-    rhs._numCapacity = 0;
+    rhs._start = rhs.inlineData();
+    rhs._numElems = 0;
+    rhs._numCapacity = InlineCount;
 }
 
-template <typename T, typename A>
-vector<T, A>::~vector() noexcept
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::swap(basic_vector& rhs)
 {
-    for (int64_t ii = size() - 1; ii >= 0; --ii)
-        std::allocator_traits<A>::destroy(_alloc, _start + ii); // destructors nothrow as required by our and STL's API
-    _alloc.deallocate(_start, _numCapacity); // the std::allocator doesn't need the capacity, but others might
+    if constexpr (PROPAGATE_ON_SWAP)
+    {
+        using std::swap;
+        swap(_alloc, rhs._alloc);
+    }
+    if (!isInline() && !rhs.isInline())
+    {
+        std::swap(_start, rhs._start);
+        std::swap(_numElems, rhs._numElems);
+        std::swap(_numCapacity, rhs._numCapacity);
+        return;
+    }
+    // inline elements can't change hands with a pointer swap, so they go through a third vector
+    basic_vector tmp(std::move(rhs));
+    rhs.take(*this);
+    take(tmp);
 }
 
-template <typename T, typename A>
-void vector<T, A>::reserve(size_t newCapacity)
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::destroy(size_t from, size_t to) noexcept
 {
-    if (newCapacity <= _numCapacity)
-        return;
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+        while (to > from)
+            Traits::destroy(_alloc, _start + --to);
+    }
+}
 
-    T* newBuf = _alloc.allocate(newCapacity);
-    int64_t ii = size() - 1;
-    try
+// moves count elements from src to uninitialized dest, leaving src uninitialized. trivially relocatable
+// elements are memcpy'd, anything else is moved if that can't throw and copied otherwise, so if a copy
+// throws the source is still intact and the ones made so far are destroyed before it's rethrown.
+// (no realloc: the memory comes from A, which needn't be malloc's)
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::relocate(A& alloc, T* dest, T* src, size_t count)
+{
+    if constexpr (is_trivially_relocatable<T>::value)
+    {
+        if (count)
+            std::memcpy(static_cast<void*>(dest), static_cast<const void*>(src), count * sizeof(T));
+    }
+    else
     {
-        for (ii = size() - 1; ii >= 0; --ii)
+        size_t ii = 0;
+        try
         {
-            std::allocator_traits<A>::construct(_alloc, newBuf + ii, std::move(_start[ii])); // non-moveable T will copy
-            std::allocator_traits<A>::destroy(_alloc, _start + ii);
+            for (; ii < count; ++ii)
+                Traits::construct(alloc, dest + ii, std::move_if_noexcept(src[ii]));
         }
-        _alloc.deallocate(_start, _numCapacity);
-        _start = newBuf;
-        _numCapacity = newCapacity;
+        catch (...)
+        {
+            while (ii > 0)
+                Traits::destroy(alloc, dest + --ii);
+            throw;
+        }
+        for (ii = count; ii > 0;)
+            Traits::destroy(alloc, src + --ii);
+    }
+}
+
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::reallocate(size_t newCapacity)
+{
+    T* newBuf = newCapacity ? Traits::allocate(_alloc, newCapacity) : nullptr;
+    try
+    {
+        relocate(_alloc, newBuf, _start, _numElems);
     }
     catch (...)
     {
-        // if exception is thrown, it must be thrown by the construction of T, so we need to rewind
-        // and destruct any already-constructed Ts
-        ++ii;
-        for (; ii < int64_t(size()); ++ii)
-            std::allocator_traits<A>::destroy(_alloc, newBuf + ii);
+        Traits::deallocate(_alloc, newBuf, newCapacity);
+        throw;
     }
+    release();
+    _start = newBuf;
+    _numCapacity = newCapacity;
 }
 
-template <typename T, typename A>
-void vector<T, A>::resize(size_t newElems)
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::reserve(size_t newCapacity)
+{
+    if (newCapacity > _numCapacity)
+        reallocate(newCapacity);
+}
+
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::resize(size_t newElems)
 {
     if (newElems < _numElems)
-    {
-        for (int64_t ii = int64_t(_numElems) - 1; ii >= newElems; --ii)
-            std::allocator_traits<A>::destroy(_alloc, _start + ii);
-    }
+        destroy(newElems, _numElems);
     else if (newElems > _numElems)
     {
-        if (newElems > _numCapacity)
-            reserve(newElems);
+        reserve(newElems);
         for (size_t ii = _numElems; ii < newElems; ++ii)
-            std::allocator_traits<A>::construct(_alloc, _start + ii);
+        {
+            Traits::construct(_alloc, _start + ii);
+            _numElems = ii + 1; // so a throwing constructor leaves the ones made so far
+        }
     }
     _numElems = newElems;
 }
 
-template <typename T, typename A>
-void vector<T, A>::resize(size_t newElems, const T& value) // doesn't require a default constructor
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::resize(size_t newElems, const T& value) // doesn't require a default constructor
 {
     if (newElems < _numElems)
-    {
-        for (int64_t ii = _numElems - 1; ii >= newElems; --ii)
-            std::allocator_traits<A>::destroy(_alloc, _start + ii);
-    }
+        destroy(newElems, _numElems);
     else if (newElems > _numElems)
     {
         if (newElems > _numCapacity)
+        {
+            T copy(value); // value might be one of ours, which the reallocation moves
             reserve(newElems);
+            resize(newElems, copy);
+            return;
+        }
         for (size_t ii = _numElems; ii < newElems; ++ii)
-            std::allocator_traits<A>::construct(_alloc, _start + ii, value); // no move. value is an exemplar for copying into the extra slots
+        {
+            Traits::construct(_alloc, _start + ii, value); // no move. value is an exemplar for copying into the extra slots
+            _numElems = ii + 1;
+        }
     }
     _numElems = newElems;
 }
 
-template <typename T, typename A>
-void vector<T, A>::pop_back()
+template <typename T, typename A, size_t InlineCount>
+template <typename... Args>
+T& basic_vector<T, A, InlineCount>::emplace_back(Args&&... args)
 {
-    std::allocator_traits<A>::destroy(_alloc, _start + _numElems - 1); // UB if size() is already 0, intentional. C++ yay!
-    --_numElems;
+    if (_numElems < _numCapacity)
+    {
+        Traits::construct(_alloc, _start + _numElems, std::forward<Args>(args)...);
+        return _start[_numElems++];
+    }
+
+    // the new element is made in the new buffer before the old ones move, as args may refer to one of them
+    size_t newCapacity = grownCapacity(_numElems + 1);
+    T* newBuf = Traits::allocate(_alloc, newCapacity);
+    try
+    {
+        Traits::construct(_alloc, newBuf + _numElems, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        Traits::deallocate(_alloc, newBuf, newCapacity);
+        throw;
+    }
+    try
+    {
+        relocate(_alloc, newBuf, _start, _numElems);
+    }
+    catch (...)
+    {
+        Traits::destroy(_alloc, newBuf + _numElems);
+        Traits::deallocate(_alloc, newBuf, newCapacity);
+        throw;
+    }
+    release();
+    _start = newBuf;
+    _numCapacity = newCapacity;
+    return _start[_numElems++];
 }
 
-template <typename T, typename A>
-void vector<T, A>::shrink_to_fit()
+template <typename T, typename A, size_t InlineCount>
+template <typename... Args>
+typename basic_vector<T, A, InlineCount>::iterator basic_vector<T, A, InlineCount>::emplace(const_iterator pos, Args&&... args)
 {
-    if (_numCapacity > _numElems)
+    size_t idx = size_t(pos - cbegin());
+    emplace_back(std::forward<Args>(args)...);
+    std::rotate(_start + idx, _start + _numElems - 1, _start + _numElems);
+    return begin() + idx;
+}
+
+template <typename T, typename A, size_t InlineCount>
+typename basic_vector<T, A, InlineCount>::iterator basic_vector<T, A, InlineCount>::insert(const_iterator pos, size_t count, const T& value)
+{
+    size_t idx = size_t(pos - cbegin());
+    if (count == 0)
+        return begin() + idx;
+    T copy(value);
+    size_t oldElems = _numElems;
+    if (_numElems + count > _numCapacity)
+        reallocate(grownCapacity(_numElems + count));
+    try
     {
-        if (_numElems)
-        {
-            T* newBuf = _alloc.allocate(_numElems);
-            int64_t ii = size() - 1;
-            try
-            {
-                for (; ii >= 0; --ii)
-                {
-                    std::allocator_traits<A>::construct(_alloc, newBuf + ii, std::move(_start[ii])); // non-moveable T will copy
-                    std::allocator_traits<A>::destroy(_alloc, _start + ii);
-                }
-                _alloc.deallocate(_start, _numCapacity);
-                _start = newBuf;
-                _numCapacity = _numElems;
-            }
-            catch (...)
-            {
-                // if exception is thrown, it must be thrown by the construction of T, so we need to rewind
-                // and destruct any already-constructed Ts
-                ++ii;
-                for (; ii < int64_t(size()); ++ii)
-                    std::allocator_traits<A>::destroy(_alloc, newBuf + ii);
-            }
-        }
-        else
-        {
-            _alloc.deallocate(_start, _numCapacity);
-            _start = nullptr;
-            _numCapacity = 0;
-        }
+        for (size_t ii = 0; ii < count; ++ii)
+            emplace_back(copy);
     }
+    catch (...)
+    {
+        destroy(oldElems, _numElems);
+        _numElems = oldElems;
+        throw;
+    }
+    std::rotate(_start + idx, _start + oldElems, _start + _numElems);
+    return begin() + idx;
+}
+
+template <typename T, typename A, size_t InlineCount>
+template <std::input_iterator It>
+typename basic_vector<T, A, InlineCount>::iterator basic_vector<T, A, InlineCount>::insert(const_iterator pos, It first, It last)
+{
+    size_t idx = size_t(pos - cbegin());
+    size_t oldElems = _numElems;
+    if constexpr (std::forward_iterator<It>)
+    {
+        size_t count = size_t(std::distance(first, last));
+        if (_numElems + count > _numCapacity)
+            reallocate(grownCapacity(_numElems + count));
+    }
+    try
+    {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+    catch (...)
+    {
+        destroy(oldElems, _numElems);
+        _numElems = oldElems;
+        throw;
+    }
+    std::rotate(_start + idx, _start + oldElems, _start + _numElems);
+    return begin() + idx;
+}
+
+template <typename T, typename A, size_t InlineCount>
+typename basic_vector<T, A, InlineCount>::iterator basic_vector<T, A, InlineCount>::erase(const_iterator first, const_iterator last)
+{
+    size_t idx = size_t(first - cbegin());
+    size_t count = size_t(last - first);
+    if (count)
+    {
+        std::move(_start + idx + count, _start + _numElems, _start + idx);
+        destroy(_numElems - count, _numElems);
+        _numElems -= count;
+    }
+    return begin() + idx;
+}
+
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::assign(size_t count, const T& value)
+{
+    T copy(value); // value might be one of ours
+    clear();
+    resize(count, copy);
 }
 
-template <typename T, typename A>
-void vector<T, A>::push_back(const T& value)
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::pop_back()
 {
-    if (_numCapacity == _numElems)
-        reserve(_numCapacity == 0 ? 1 : _numCapacity * 2);
-    std::allocator_traits<A>::construct(_alloc, _start + _numElems, value);
-    ++_numElems;
+    Traits::destroy(_alloc, _start + _numElems - 1); // UB if size() is already 0, intentional. C++ yay!
+    --_numElems;
 }
 
-template <typename T, typename A>
-void vector<T, A>::push_back(T&& value)
+template <typename T, typename A, size_t InlineCount>
+void basic_vector<T, A, InlineCount>::shrink_to_fit()
 {
-    if (_numCapacity == _numElems)
-        reserve(_numCapacity == 0 ? 1 : _numCapacity * 2);
-    std::allocator_traits<A>::construct(_alloc, _start + _numElems, std::move(value));
-    ++_numElems;
+    if (_numCapacity <= _numElems || isInline())
+        return;
+    if (_numElems > InlineCount)
+    {
+        reallocate(_numElems);
+        return;
+    }
+    T* heap = _start;
+    size_t heapCapacity = _numCapacity;
+    relocate(_alloc, inlineData(), heap, _numElems);
+    Traits::deallocate(_alloc, heap, heapCapacity);
+    _start = inlineData();
+    _numCapacity = InlineCount;
 }
 
-template <typename T, typename A>
-T& vector<T, A>::operator[](size_t index)
+template <typename T, typename A, size_t InlineCount>
+T& basic_vector<T, A, InlineCount>::operator[](size_t index)
 {
     return _start[index];
 }
 
-template <typename T, typename A>
-const T& vector<T, A>::operator[](size_t index) const
+template <typename T, typename A, size_t InlineCount>
+const T& basic_vector<T, A, InlineCount>::operator[](size_t index) const
 {
     return _start[index];
 }
 
-template <typename T, typename A>
-vector<T, A>& vector<T, A>::operator=(vector rhs)
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>& basic_vector<T, A, InlineCount>::operator=(const basic_vector& rhs)
+{
+    if (this == &rhs)
+        return *this;
+    if constexpr (PROPAGATE_ON_COPY)
+    {
+        if (!Traits::is_always_equal::value && _alloc != rhs._alloc)
+        {
+            clear(); // our buffer has to go back to the allocator it came from
+            release();
+        }
+        _alloc = rhs._alloc;
+    }
+    assign(rhs.begin(), rhs.end());
+    return *this;
+}
+
+template <typename T, typename A, size_t InlineCount>
+basic_vector<T, A, InlineCount>& basic_vector<T, A, InlineCount>::operator=(basic_vector&& rhs)
 {
-    swap(rhs);
+    if (this == &rhs)
+        return *this;
+    if (PROPAGATE_ON_MOVE || Traits::is_always_equal::value || _alloc == rhs._alloc)
+    {
+        clear();
+        release();
+        if constexpr (PROPAGATE_ON_MOVE)
+            _alloc = std::move(rhs._alloc);
+        take(rhs);
+    }
+    else
+    {
+        assign(std::make_move_iterator(rhs.begin()), std::make_move_iterator(rhs.end()));
+        rhs.clear();
+    }
     return *this;
 }
 
+static_assert(std::contiguous_iterator<vector<int>::iterator>);
+static_assert(std::contiguous_iterator<vector<int>::const_iterator>);
+static_assert(sizeof(vector<int>) == 3 * sizeof(void*)); // the allocator and the absent slots take no room
+
 } // namespace bear
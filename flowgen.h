@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+#include "sink.h"
+
+// seeded synthetic order flow for gen and bench. the same config always gives the same stream, on any
+// platform, since it brings its own random numbers instead of <random>'s implementation defined
+// distributions.
+// every message is an add (resting a tick or more behind mid), an aggressive add (crossing mid by up to a
+// quarter of the band), a cancel or a revise of an order the generator thinks is live. it doesn't run a
+// book, so orders it thinks are live may already have filled, and then the cancel or revise is a no-op in
+// the Market as well. once depth orders are live, adds become cancels, which keeps the book around depth.
+// with --immediate some aggressive adds are IOC, FOK or MARKET orders instead, which never go live.
+
+struct FlowConfig
+{
+    uint64_t seed = 1;
+    size_t messages = 1000000;
+    int32_t startPrice = 10000;
+    int32_t band = 50; // ticks from mid that passive orders rest within
+    size_t depth = 10000; // live orders to aim for, summed over both sides
+    unsigned addPercent = 50;
+    unsigned cancelPercent = 30;
+    unsigned revisePercent = 15; // whatever is left of 100 are aggressive adds
+    unsigned immediatePercent = 0; // of the aggressive adds, sent as IOC, FOK or MARKET (a third each) instead
+    int32_t maxQty = 100;
+    size_t symbols = 0; // 0 leaves the symbol off, otherwise each message goes to a random one of S0, S1, ...
+    uint64_t firstId = 1;
+};
+
+constexpr size_t MAX_COMMAND_BYTES = 128;
+
+// one input line without its newline, into a buffer with at least MAX_COMMAND_BYTES of room (so symbols
+// longer than 64 bytes aren't supported)
+inline char* FormatCommand(char* out, const Command& cmd)
+{
+    out = PutNumber(out, cmd.orderId);
+    switch (cmd.type)
+    {
+    case CommandType::Buy:
+        out = PutText(out, " BUY ", 5);
+        break;
+    case CommandType::Sell:
+        out = PutText(out, " SELL ", 6);
+        break;
+    case CommandType::Revise:
+        out = PutText(out, " REVISE ", 8);
+        break;
+    case CommandType::Cancel:
+        out = PutText(out, " CANCEL", 7);
+        break;
+    case CommandType::Depth:
+        out = PutText(out, " DEPTH ", 7);
+        break;
+    case CommandType::Stats:
+        out = PutText(out, " STATS", 6);
+        break;
+    case CommandType::IocBuy:
+    case CommandType::IocSell:
+        out = PutText(out, " IOC ", 5);
+        break;
+    case CommandType::FokBuy:
+    case CommandType::FokSell:
+        out = PutText(out, " FOK ", 5);
+        break;
+    case CommandType::MarketBuy:
+    case CommandType::MarketSell:
+        out = PutText(out, " MARKET ", 8);
+        break;
+    default:
+        out = PutText(out, " INVALID", 8);
+        break;
+    }
+    if (IsImmediate(cmd.type))
+        out = ImmediateIsBuy(cmd.type) ? PutText(out, "BUY ", 4) : PutText(out, "SELL ", 5);
+    if (cmd.type == CommandType::Buy || cmd.type == CommandType::Sell || cmd.type == CommandType::Revise
+        || (IsImmediate(cmd.type) && ImmediateKindOf(cmd.type) != ImmediateKind::Market))
+    {
+        out = PutNumber(out, cmd.qty);
+        *out++ = ' ';
+        out = PutNumber(out, cmd.price);
+    }
+    else if (cmd.type == CommandType::Depth || IsImmediate(cmd.type))
+        out = PutNumber(out, cmd.qty);
+    if (!cmd.symbol.empty())
+    {
+        *out++ = ' ';
+        out = PutText(out, cmd.symbol.data(), cmd.symbol.size());
+    }
+    return out;
+}
+
+// splitmix64
+class FlowRandom
+{
+public:
+    explicit FlowRandom(uint64_t seed) : _state(seed) {}
+
+    uint64_t Next()
+    {
+        uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // [0, n), n > 0. the modulo bias is far too small to matter for order flow
+    uint64_t Below(uint64_t n) { return Next() % n; }
+
+private:
+    uint64_t _state;
+};
+
+class FlowGenerator
+{
+public:
+    explicit FlowGenerator(const FlowConfig& config)
+        : _config(config)
+        , _random(config.seed)
+        , _nextId(config.firstId)
+        , _books(config.symbols ? config.symbols : 1)
+    {
+        for (size_t ii = 0; ii < _books.size(); ++ii)
+        {
+            if (config.symbols)
+                _books[ii].symbol = "S" + std::to_string(ii);
+            _books[ii].mid = config.startPrice;
+        }
+    }
+
+    // false once config.messages have been made. cmd.symbol stays valid as long as the generator
+    bool Next(Command& cmd)
+    {
+        if (_made == _config.messages)
+            return false;
+        ++_made;
+        Book& book = _books[_books.size() == 1 ? 0 : _random.Below(_books.size())];
+        cmd.symbol = book.symbol;
+        if (_random.Below(64) == 0)
+            book.mid += _random.Below(2) ? 1 : -1;
+
+        unsigned roll = unsigned(_random.Below(100));
+        bool add = roll < _config.addPercent;
+        bool cancel = !add && roll < _config.addPercent + _config.cancelPercent;
+        bool revise = !add && !cancel && roll < _config.addPercent + _config.cancelPercent + _config.revisePercent;
+        bool full = _liveCount >= _config.depth;
+        if (book.live.empty())
+            cancel = revise = false;
+        else if (full && (add || (!cancel && !revise)))
+        {
+            add = false;
+            cancel = true;
+        }
+
+        if (cancel)
+        {
+            size_t idx = _random.Below(book.live.size());
+            cmd.type = CommandType::Cancel;
+            cmd.orderId = book.live[idx].orderId;
+            cmd.qty = 0;
+            cmd.price = 0;
+            book.live[idx] = book.live.back();
+            book.live.pop_back();
+            --_liveCount;
+            return true;
+        }
+        if (revise)
+        {
+            const LiveOrder& order = book.live[_random.Below(book.live.size())];
+            cmd.type = CommandType::Revise;
+            cmd.orderId = order.orderId;
+            cmd.qty = Qty();
+            cmd.price = PassivePrice(book, order.isBuy);
+            return true;
+        }
+
+        bool isBuy = _random.Below(2);
+        cmd.type = isBuy ? CommandType::Buy : CommandType::Sell;
+        cmd.orderId = _nextId++;
+        cmd.qty = Qty();
+        if (add)
+            cmd.price = PassivePrice(book, isBuy);
+        else
+        {
+            int32_t through = int32_t(_random.Below(uint64_t(_config.band / 4 + 1)));
+            cmd.price = isBuy ? book.mid + through : book.mid - through;
+            // no extra draw without --immediate, so the streams from before it stay the same
+            if (_config.immediatePercent && _random.Below(100) < _config.immediatePercent)
+            {
+                ImmediateKind kind = ImmediateKind(_random.Below(3));
+                cmd.type = ImmediateType(kind, isBuy);
+                if (kind == ImmediateKind::Market)
+                    cmd.price = 0;
+                return true;
+            }
+        }
+        book.live.push_back(LiveOrder{cmd.orderId, isBuy});
+        ++_liveCount;
+        return true;
+    }
+
+private:
+    struct LiveOrder
+    {
+        uint64_t orderId;
+        bool isBuy;
+    };
+
+    struct Book
+    {
+        std::string symbol;
+        int32_t mid = 0;
+        std::vector<LiveOrder> live;
+    };
+
+    int32_t Qty() { return 1 + int32_t(_random.Below(uint64_t(_config.maxQty))); }
+
+    int32_t PassivePrice(const Book& book, bool isBuy)
+    {
+        int32_t away = 1 + int32_t(_random.Below(uint64_t(_config.band)));
+        return isBuy ? book.mid - away : book.mid + away;
+    }
+
+    FlowConfig _config;
+    FlowRandom _random;
+    uint64_t _nextId;
+    size_t _made = 0;
+    size_t _liveCount = 0;
+    std::vector<Book> _books;
+};
+
+// shared by gen and bench. consumes argv[ii] (and its value) if it's a flow option, false if it isn't one
+inline bool ParseFlowOption(int argc, char** argv, int& ii, FlowConfig& config)
+{
+    std::string_view arg = argv[ii];
+    if (ii + 1 >= argc)
+        return false;
+    auto value = [&] { return std::stoull(argv[++ii]); };
+    if (arg == "--seed")
+        config.seed = value();
+    else if (arg == "--messages")
+        config.messages = value();
+    else if (arg == "--start-price")
+        config.startPrice = int32_t(std::stol(argv[++ii]));
+    else if (arg == "--band")
+        config.band = int32_t(value());
+    else if (arg == "--depth")
+        config.depth = value();
+    else if (arg == "--add")
+        config.addPercent = unsigned(value());
+    else if (arg == "--cancel")
+        config.cancelPercent = unsigned(value());
+    else if (arg == "--revise")
+        config.revisePercent = unsigned(value());
+    else if (arg == "--immediate")
+        config.immediatePercent = unsigned(value());
+    else if (arg == "--max-qty")
+        config.maxQty = int32_t(value());
+    else if (arg == "--symbols")
+        config.symbols = value();
+    else if (arg == "--first-id")
+        config.firstId = value();
+    else
+        return false;
+    return true;
+}
+
+// the percentages must leave room for each other, and the ranges must be non-empty
+inline bool CheckFlowConfig(const FlowConfig& config)
+{
+    return config.addPercent + config.cancelPercent + config.revisePercent <= 100 && config.immediatePercent <= 100
+           && config.band > 0 && config.maxQty > 0;
+}
+
+constexpr const char* FLOW_USAGE = "[--seed N] [--messages N] [--start-price P] [--band TICKS] [--depth ORDERS]\n"
+                                   "          [--add PCT] [--cancel PCT] [--revise PCT] [--immediate PCT] [--max-qty Q] [--symbols N]\n"
+                                   "          [--first-id ID]";
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "market.h"
+#include "reader.h"
+#include "router.h"
+#include "sink.h"
+
+// session mode: one Market shared by any number of local gateways, each a session on a Unix domain stream
+// socket (--listen) or a pair of FIFOs (--fifo). a single thread multiplexes them with epoll, and every
+// wakeup goes the same way: one read() of up to SESSION_READ_BYTES from each readable session, cut into
+// whole lines and parsed, then the parsed commands are fed to the Market round robin, SESSION_FAIR_SHARE
+// at a time per session, so a gateway sending a flood only gets its turn like the rest. last, each session
+// gets one write() of everything it has pending. so the syscalls go with the wakeups, not the messages.
+//
+// a session gets the output of its own commands, as it would have from trade on its input. TRADE lines go
+// to every session, and with --depth-updates so do the DEPTH lines, they're the public part. the sessions
+// share the one order id space the gateways hand out, the frontend doesn't check who cancels what.
+//
+// a socket session ends when the gateway shuts down its side (or on an id, qty or price which isn't a
+// number, like the end of trade's input, or on a line longer than SESSION_LINE_LIMIT), and the socket is
+// closed once its output has gone out. FIFOs are
+// opened read-write, which Linux allows, so they never see an end of input or fail for want of a reader,
+// and a FIFO session lasts as long as the frontend. SIGINT or SIGTERM stops it.
+
+constexpr size_t SESSION_READ_BYTES = 64 * 1024;
+constexpr size_t SESSION_FAIR_SHARE = 64; // commands
+constexpr size_t SESSION_OUTPUT_HIGH_WATER = 4 * 1024 * 1024; // don't read a session's input past this much output
+constexpr size_t SESSION_OUTPUT_LIMIT = 64 * 1024 * 1024; // drop a session this far behind on its output
+constexpr size_t SESSION_LINE_LIMIT = 1024 * 1024; // end a session's input at a line longer than this
+constexpr int SESSION_MAX_EVENTS = 64;
+
+inline volatile std::sig_atomic_t frontendStopRequested = 0;
+
+inline void RequestFrontendStop(int) { frontendStopRequested = 1; }
+
+struct Session
+{
+    Session(int in, int out, std::string n)
+        : inFd(in)
+        , outFd(out)
+        , name(std::move(n))
+    {
+        input.resize(SESSION_READ_BYTES);
+    }
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    ~Session()
+    {
+        close(inFd);
+        if (outFd != inFd)
+            close(outFd);
+    }
+
+    int inFd;
+    int outFd; // the same as inFd for a socket
+    std::string name; // for messages
+    std::vector<char> input;
+    size_t inputFilled = 0; // the start of a line which hasn't all arrived
+    std::vector<Command> commands; // parsed and waiting for their turn
+    size_t nextCommand = 0;
+    ByteBuffer output;
+    uint32_t interest = 0; // what epoll is watching for, EPOLLIN and EPOLLOUT
+    bool registered = false; // with epoll
+    bool inputOpen = true;
+    bool outputOpen = true; // false once a write() failed, its output is thrown away
+};
+
+// replies go to the session whose command is being processed, TRADE and DEPTH lines to all of them
+class SessionSink : public EventSink
+{
+public:
+    explicit SessionSink(std::vector<std::unique_ptr<Session>>& sessions)
+        : _sessions(sessions)
+    {
+    }
+
+    void SetCurrent(Session& session) { _current = &session; }
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        EndLine(FormatOrder(Room(), isBuy, qty, price, orderId));
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override { EndLine(FormatRevise(Room(), qty, price, orderId)); }
+    void OnCancel(uint64_t orderId, int32_t qty) override { EndLine(FormatCancel(Room(), orderId, qty)); }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        Broadcast(FormatTrade(_line, aggressorId, passiveId, qty, price));
+    }
+
+    void OnParseError() override { EndLine(FormatParseError(Room())); }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        EndLine(FormatImmediate(Room(), kind, isBuy, qty, price, orderId));
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        Broadcast(FormatDepth(_line, isBuy, price, qty, orders));
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        EndLine(FormatBook(Room(), requestId, bidLevels, askLevels));
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        EndLine(FormatBookLevel(Room(), isBuy, price, qty, orders));
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override { EndLine(FormatStats(Room(), requestId, count)); }
+    void OnStat(StatId stat, uint64_t value) override { EndLine(FormatStat(Room(), stat, value)); }
+
+private:
+    char* Room() { return _current->output.reserveTail(MAX_EVENT_BYTES); }
+
+    void EndLine(char* lineEnd)
+    {
+        *lineEnd++ = '\n';
+        _current->output.commit(lineEnd);
+    }
+
+    void Broadcast(char* lineEnd)
+    {
+        *lineEnd++ = '\n';
+        for (auto& session : _sessions)
+        {
+            if (session->outputOpen)
+                session->output.append(_line, size_t(lineEnd - _line));
+        }
+    }
+
+    std::vector<std::unique_ptr<Session>>& _sessions;
+    Session* _current = nullptr;
+    char _line[MAX_EVENT_BYTES + 1];
+};
+
+class SessionFrontend
+{
+public:
+    explicit SessionFrontend(const MarketConfig& config)
+        : _sink(_sessions)
+        , _market(_sink, config)
+    {
+        _epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epollFd < 0)
+            perror("epoll_create1");
+    }
+
+    SessionFrontend(const SessionFrontend&) = delete;
+    SessionFrontend& operator=(const SessionFrontend&) = delete;
+
+    ~SessionFrontend()
+    {
+        _sessions.clear();
+        if (_listenFd >= 0)
+            close(_listenFd);
+        if (!_listenPath.empty())
+            unlink(_listenPath.c_str());
+        if (_epollFd >= 0)
+            close(_epollFd);
+    }
+
+    // a stale socket left at path by an earlier run is replaced, anything else there is an error
+    bool Listen(const std::string& path)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "%s: socket path too long\n", path.c_str());
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(path.c_str());
+        _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_listenFd < 0 || bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || listen(_listenFd, SOMAXCONN) != 0)
+        {
+            perror(path.c_str());
+            return false;
+        }
+        _listenPath = path;
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr; // the listener, sessions have their Session
+        return epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event) == 0;
+    }
+
+    bool AddFifoSession(const std::string& inPath, const std::string& outPath)
+    {
+        int inFd = open(inPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (inFd < 0)
+        {
+            perror(inPath.c_str());
+            return false;
+        }
+        int outFd = open(outPath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (outFd < 0)
+        {
+            perror(outPath.c_str());
+            close(inFd);
+            return false;
+        }
+        AddSession(inFd, outFd, inPath);
+        return true;
+    }
+
+    // until SIGINT or SIGTERM. false if epoll fails
+    bool Run()
+    {
+        std::signal(SIGPIPE, SIG_IGN); // a gateway gone away shows up as EPIPE from write()
+        std::signal(SIGINT, RequestFrontendStop);
+        std::signal(SIGTERM, RequestFrontendStop);
+        epoll_event events[SESSION_MAX_EVENTS];
+        while (!frontendStopRequested)
+        {
+            int numEvents = epoll_wait(_epollFd, events, SESSION_MAX_EVENTS, -1);
+            if (numEvents < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("epoll_wait");
+                return false;
+            }
+            for (int ii = 0; ii < numEvents; ++ii)
+            {
+                Session* session = static_cast<Session*>(events[ii].data.ptr);
+                if (!session)
+                    Accept();
+                else if (session->inputOpen && (session->interest & EPOLLIN))
+                    ReadInput(*session); // the output is written below, whatever woke it
+            }
+            Sequence();
+            FinishRound();
+        }
+        FinishRound(); // whatever the sockets take now
+        return true;
+    }
+
+private:
+    void AddSession(int inFd, int outFd, std::string name)
+    {
+        _sessions.push_back(std::make_unique<Session>(inFd, outFd, std::move(name)));
+        UpdateInterest(*_sessions.back());
+    }
+
+    void Accept()
+    {
+        while (true)
+        {
+            int fd = accept4(_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    perror("accept");
+                return;
+            }
+            AddSession(fd, fd, _listenPath + " #" + std::to_string(++_accepted));
+        }
+    }
+
+    // one read(), then every whole line in the buffer is parsed. the partial one left is moved to the front
+    void ReadInput(Session& session)
+    {
+        if (session.inputFilled == session.input.size()) // a single line longer than the buffer
+        {
+            if (session.input.size() >= SESSION_LINE_LIMIT)
+            {
+                fprintf(stderr, "%s: a line longer than %zu KB, ending its input\n", session.name.c_str(),
+                        SESSION_LINE_LIMIT / 1024);
+                session.inputOpen = false;
+                session.inputFilled = 0;
+                return;
+            }
+            session.input.resize(std::min(session.input.size() * 2, SESSION_LINE_LIMIT));
+        }
+        ssize_t numRead = read(session.inFd, session.input.data() + session.inputFilled, session.input.size() - session.inputFilled);
+        if (numRead < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return;
+            numRead = 0; // an error ends its input like EOF
+        }
+        const char* begin = session.input.data();
+        const char* end = begin + session.inputFilled + size_t(numRead);
+        if (numRead == 0)
+            session.inputOpen = false; // a last line without its newline still counts
+        else
+        {
+            session.inputFilled += size_t(numRead);
+            const void* lastNewline = memrchr(begin, '\n', session.inputFilled);
+            end = lastNewline ? static_cast<const char*>(lastNewline) + 1 : begin;
+        }
+        for (const char* p = begin; p < end;)
+        {
+            Command cmd;
+            p = ParseCommand(p, end, cmd);
+            if (cmd.type == CommandType::Stop)
+            {
+                session.inputOpen = false;
+                break;
+            }
+            if (cmd.type != CommandType::None)
+            {
+                cmd.symbol = std::string_view(); // there's one book, and the line is about to be moved
+                session.commands.push_back(cmd);
+            }
+            if (!p) // cmd was the session's last
+            {
+                session.inputOpen = false;
+                break;
+            }
+        }
+        size_t left = session.inputOpen ? session.inputFilled - size_t(end - begin) : 0;
+        std::memmove(session.input.data(), end, left);
+        session.inputFilled = left;
+    }
+
+    // round robin over the sessions' parsed commands, a fair share from each per turn, until all are done
+    void Sequence()
+    {
+        for (bool more = true; more;)
+        {
+            more = false;
+            for (auto& session : _sessions)
+            {
+                size_t stop = std::min(session->commands.size(), session->nextCommand + SESSION_FAIR_SHARE);
+                if (session->nextCommand == stop)
+                    continue;
+                _sink.SetCurrent(*session);
+                for (; session->nextCommand < stop; ++session->nextCommand)
+                    _market.Process(session->commands[session->nextCommand]);
+                more |= stop < session->commands.size();
+            }
+        }
+        for (auto& session : _sessions)
+        {
+            session->commands.clear();
+            session->nextCommand = 0;
+        }
+    }
+
+    // one write() per session with output, then the epoll interest is brought up to date and the sessions
+    // which are done are closed
+    void FinishRound()
+    {
+        for (auto& session : _sessions)
+        {
+            if (session->output.size())
+                WriteOutput(*session);
+            if (session->output.size() > SESSION_OUTPUT_LIMIT)
+            {
+                fprintf(stderr, "%s: more than %zu MB of output waiting, dropping it\n", session->name.c_str(),
+                        SESSION_OUTPUT_LIMIT / (1024 * 1024));
+                session->inputOpen = false;
+                session->outputOpen = false;
+            }
+            if (!session->outputOpen)
+                session->output.clear();
+        }
+        auto done = [](const std::unique_ptr<Session>& session)
+        { return !session->inputOpen && (!session->outputOpen || session->output.size() == 0); };
+        _sessions.erase(std::remove_if(_sessions.begin(), _sessions.end(), done), _sessions.end()); // closes them
+        for (auto& session : _sessions)
+            UpdateInterest(*session);
+    }
+
+    void WriteOutput(Session& session)
+    {
+        ssize_t written = write(session.outFd, session.output.data(), session.output.size());
+        if (written > 0)
+            session.output.consume(size_t(written));
+        else if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            session.inputOpen = false; // nobody is listening to the answers
+            session.outputOpen = false;
+        }
+    }
+
+    // input while it's open and the session isn't too far behind on its output, output while any is waiting.
+    // a socket has both on one fd, FIFOs each on their own, with the same Session as data
+    void UpdateInterest(Session& session)
+    {
+        uint32_t interest = 0;
+        if (session.inputOpen && session.output.size() < SESSION_OUTPUT_HIGH_WATER)
+            interest |= EPOLLIN;
+        if (session.outputOpen && session.output.size())
+            interest |= EPOLLOUT;
+        if (session.registered && interest == session.interest)
+            return;
+        auto control = [&](int fd, uint32_t events)
+        {
+            epoll_event event = {};
+            event.events = events;
+            event.data.ptr = &session;
+            epoll_ctl(_epollFd, session.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+        };
+        if (session.inFd == session.outFd)
+            control(session.inFd, interest);
+        else
+        {
+            uint32_t changed = session.registered ? interest ^ session.interest : EPOLLIN | EPOLLOUT;
+            if (changed & EPOLLIN)
+                control(session.inFd, interest & EPOLLIN);
+            if (changed & EPOLLOUT)
+                control(session.outFd, interest & EPOLLOUT);
+        }
+        session.interest = interest;
+        session.registered = true;
+    }
+
+    std::vector<std::unique_ptr<Session>> _sessions;
+    SessionSink _sink;
+    Market _market;
+    int _epollFd = -1;
+    int _listenFd = -1;
+    std::string _listenPath;
+    uint64_t _accepted = 0;
+};
@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <vector>
+
+#include "command.h"
+#include "flowgen.h"
+#include "sink.h"
+
+// writes a synthetic order flow (see flowgen.h) to stdout in trade's text input format, e.g.
+//   gen --seed 7 --messages 5000000 --band 200 > flow.txt
+
+int main(int argc, char** argv)
+{
+    FlowConfig config;
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        if (!ParseFlowOption(argc, argv, ii, config))
+        {
+            fprintf(stderr, "usage: %s %s\n", argv[0], FLOW_USAGE);
+            return 1;
+        }
+    }
+    if (!CheckFlowConfig(config))
+    {
+        fprintf(stderr, "add + cancel + revise and immediate must each be at most 100, band and max qty at least 1\n");
+        return 1;
+    }
+
+    FlowGenerator generator(config);
+    std::vector<char> buffer(OUTPUT_BUFFER_BYTES);
+    char* out = buffer.data();
+    Command cmd;
+    while (generator.Next(cmd))
+    {
+        if (size_t(buffer.data() + buffer.size() - out) < MAX_COMMAND_BYTES)
+        {
+            WriteAll(STDOUT_FILENO, buffer.data(), size_t(out - buffer.data()));
+            out = buffer.data();
+        }
+        out = FormatCommand(out, cmd);
+        *out++ = '\n';
+    }
+    WriteAll(STDOUT_FILENO, buffer.data(), size_t(out - buffer.data()));
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// flat order id -> Value index for the Market, in one array of slots and without a heap node per order.
+// while the live ids are dense (the gateway hands them out counting up) a slot is found directly by its
+// offset from a base id. the window is re-based onto the oldest live id whenever it has to grow, so it
+// slides along with the ids. once live ids are too spread out for that, it turns for good into an open
+// addressing hash table with linear probing, where erase shifts the rest of the probe run back instead of
+// leaving tombstones, so lookups never get slower with churn.
+
+template <typename Value>
+class OrderIdIndex
+{
+public:
+    // allowDirect false starts (and stays) hashed
+    explicit OrderIdIndex(bool allowDirect = true)
+        : _direct(allowDirect)
+    {
+    }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    bool direct() const { return _direct; }
+    size_t bytes() const { return _slots.capacity() * sizeof(Slot); }
+
+    // room for count live orders without growing
+    void reserve(size_t count)
+    {
+        _reserved = std::max(_reserved, count);
+        if (!_direct && NeedsGrow(count))
+            Rehash(HashCapacityFor(count));
+        // a direct window can't be placed before the first id is known, Insert sizes it from _reserved
+    }
+
+    Value* find(uint64_t id)
+    {
+        if (_direct)
+        {
+            uint64_t idx = id - _base; // ids below the base wrap around to huge
+            return idx < _slots.size() && _slots[idx].used ? &_slots[idx].value : nullptr;
+        }
+        if (_slots.empty())
+            return nullptr;
+        for (size_t idx = Home(id);; idx = (idx + 1) & _mask)
+        {
+            Slot& slot = _slots[idx];
+            if (!slot.used)
+                return nullptr;
+            if (slot.key == id)
+                return &slot.value;
+        }
+    }
+
+    // finds or default-constructs
+    Value& operator[](uint64_t id)
+    {
+        if (Value* value = find(id))
+            return *value;
+        return Insert(id);
+    }
+
+    bool erase(uint64_t id)
+    {
+        if (_direct)
+        {
+            uint64_t idx = id - _base;
+            if (idx >= _slots.size() || !_slots[idx].used)
+                return false;
+            _slots[idx] = Slot();
+            --_size;
+            return true;
+        }
+        if (_slots.empty())
+            return false;
+        size_t hole = Home(id);
+        for (;; hole = (hole + 1) & _mask)
+        {
+            if (!_slots[hole].used)
+                return false;
+            if (_slots[hole].key == id)
+                break;
+        }
+        // backward shift: pull every later entry of the run which may live in the hole into it
+        for (size_t idx = (hole + 1) & _mask; _slots[idx].used; idx = (idx + 1) & _mask)
+        {
+            size_t home = Home(_slots[idx].key);
+            if (((idx - home) & _mask) >= ((idx - hole) & _mask))
+            {
+                _slots[hole] = _slots[idx];
+                hole = idx;
+            }
+        }
+        _slots[hole] = Slot();
+        --_size;
+        return true;
+    }
+
+    // start pulling in the cache line id's slot would be in
+    void prefetch(uint64_t id) const
+    {
+        if (_direct)
+        {
+            uint64_t idx = id - _base;
+            if (idx < _slots.size())
+                __builtin_prefetch(&_slots[idx]);
+        }
+        else if (!_slots.empty())
+            __builtin_prefetch(&_slots[Home(id)]);
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key = 0;
+        bool used = false;
+        Value value = Value();
+    };
+
+    static constexpr size_t MIN_DIRECT_SLOTS = 64 * 1024; // a sparse window this small is still cheap
+    static constexpr size_t MAX_DIRECT_SLOTS_PER_ORDER = 8; // sparser than this and the window goes hashed
+    static constexpr size_t MIN_HASH_SLOTS = 16;
+
+    // fibonacci hashing, spreads consecutive ids over the whole table
+    size_t Home(uint64_t id) const { return size_t((id * 0x9E3779B97F4A7C15ull) >> _shift); }
+
+    bool NeedsGrow(size_t count) const { return count * 4 > _slots.size() * 3; } // load factor 3/4
+
+    static size_t HashCapacityFor(size_t count) { return std::bit_ceil(std::max(MIN_HASH_SLOTS, count * 4 / 3 + 1)); }
+
+    Value& Insert(uint64_t id)
+    {
+        if (_direct && !Redirect(id))
+        {
+            _direct = false; // direct slots carry their keys too, so they rehash like any others
+            Rehash(HashCapacityFor(std::max(_size + 1, _reserved)));
+        }
+        if (_direct)
+        {
+            Slot& slot = _slots[id - _base];
+            slot.key = id;
+            slot.used = true;
+            ++_size;
+            return slot.value;
+        }
+        if (NeedsGrow(_size + 1))
+            Rehash(HashCapacityFor(std::max(_slots.size(), _size + 1)));
+        return Place(id).value;
+    }
+
+    // makes the direct window cover id, re-basing it on the oldest live id. false if it would be too sparse
+    bool Redirect(uint64_t id)
+    {
+        if (id - _base < _slots.size())
+            return true;
+        uint64_t low = id;
+        uint64_t high = id;
+        size_t firstLive = 0;
+        if (_size)
+        {
+            while (!_slots[firstLive].used)
+                ++firstLive;
+            size_t lastLive = _slots.size() - 1;
+            while (!_slots[lastLive].used)
+                --lastLive;
+            low = std::min(low, _base + firstLive);
+            high = std::max(high, _base + lastLive);
+        }
+        uint64_t span = high - low + 1;
+        if (span == 0 || span > std::max(MIN_DIRECT_SLOTS, MAX_DIRECT_SLOTS_PER_ORDER * (_size + 1)))
+            return false;
+
+        // twice the span leaves room for ids to keep counting up before the next move
+        std::vector<Slot> slots(std::max<size_t>({span * 2, MIN_DIRECT_SLOTS, _reserved * 2}));
+        for (size_t idx = firstLive; idx < _slots.size(); ++idx)
+        {
+            if (_slots[idx].used)
+                slots[_slots[idx].key - low] = _slots[idx];
+        }
+        _slots.swap(slots);
+        _base = low;
+        return true;
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::vector<Slot> old;
+        old.swap(_slots);
+        _slots.assign(capacity, Slot());
+        _mask = capacity - 1;
+        _shift = 64 - std::countr_zero(capacity);
+        _size = 0;
+        for (Slot& slot : old)
+        {
+            if (slot.used)
+                Place(slot.key).value = slot.value;
+        }
+    }
+
+    // new entry for an id known not to be in the hash table, which has room for it
+    Slot& Place(uint64_t id)
+    {
+        size_t idx = Home(id);
+        while (_slots[idx].used)
+            idx = (idx + 1) & _mask;
+        Slot& slot = _slots[idx];
+        slot.key = id;
+        slot.used = true;
+        ++_size;
+        return slot;
+    }
+
+    std::vector<Slot> _slots;
+    size_t _size = 0;
+    size_t _reserved = 0;
+    bool _direct;
+    uint64_t _base = 0; // id of _slots[0] while direct
+    size_t _mask = 0; // hashed only
+    int _shift = 64;
+};
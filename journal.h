@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "protocol.h"
+#include "reader.h"
+
+// write-ahead journal of every command the Market is given, appended before it's matched. the journal is a
+// directory of segments, each one an ordinary binary command file (see protocol.h, so convert can read it)
+// named after the sequence number of its first record, e.g. 00000000000000123456.journal. a segment is
+// preallocated when it's opened and the next one is started once it's full.
+// records are written in groups: with JournalSync::Batch a group is written and fdatasync'd at the end of
+// every input run (before that run's output is flushed), or sooner once the oldest record in it has waited
+// groupCommitMicros, so durability costs one sync per group rather than one per order.
+
+enum class JournalSync
+{
+    None, // write() per group, the kernel decides when it reaches the disk
+    Batch, // write() and fdatasync() per group
+    Every, // write() and fdatasync() per command, the slow reference point
+};
+
+constexpr size_t JOURNAL_GROUP_RECORDS = 4096; // a full group is committed right away
+constexpr size_t DEFAULT_JOURNAL_SEGMENT_BYTES = 64 * 1024 * 1024;
+
+struct JournalConfig
+{
+    std::string dir;
+    JournalSync sync = JournalSync::Batch;
+    uint64_t groupCommitMicros = 1000;
+    size_t segmentBytes = DEFAULT_JOURNAL_SEGMENT_BYTES;
+};
+
+// "none", "batch" or "every"
+inline bool ParseJournalSync(const std::string& name, JournalSync& sync)
+{
+    if (name == "none")
+        sync = JournalSync::None;
+    else if (name == "batch")
+        sync = JournalSync::Batch;
+    else if (name == "every")
+        sync = JournalSync::Every;
+    else
+        return false;
+    return true;
+}
+
+inline std::string JournalSegmentPath(const std::string& dir, uint64_t firstSequence)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%020" PRIu64 ".journal", firstSequence);
+    return dir + "/" + name;
+}
+
+// first sequence numbers of the segments in dir, ascending. empty if there are none (or no dir)
+inline std::vector<uint64_t> ListJournalSegments(const std::string& dir)
+{
+    std::vector<uint64_t> segments;
+    DIR* handle = opendir(dir.c_str());
+    if (!handle)
+        return segments;
+    while (dirent* entry = readdir(handle))
+    {
+        uint64_t firstSequence;
+        char rest[16];
+        if (sscanf(entry->d_name, "%20" SCNu64 "%15s", &firstSequence, rest) == 2 && std::strcmp(rest, ".journal") == 0)
+            segments.push_back(firstSequence);
+    }
+    closedir(handle);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+class Journal
+{
+public:
+    // the first record appended gets sequence number firstSequence
+    Journal(const JournalConfig& config, uint64_t firstSequence)
+        : _config(config)
+        , _nextSequence(firstSequence)
+    {
+        _config.segmentBytes = std::max(_config.segmentBytes, sizeof(BinaryFileHeader) + sizeof(BinaryCommand));
+        _group.reserve(JOURNAL_GROUP_RECORDS);
+        if (mkdir(_config.dir.c_str(), 0755) != 0 && errno != EEXIST)
+            Fail(_config.dir.c_str());
+        OpenSegment();
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal()
+    {
+        Commit();
+        close(_fd);
+    }
+
+    void Append(const Command& cmd)
+    {
+        if (_group.empty() && _config.sync == JournalSync::Batch)
+            _groupStart = std::chrono::steady_clock::now();
+        _group.push_back(EncodeCommand(cmd));
+        if (_config.sync == JournalSync::Every || _group.size() == JOURNAL_GROUP_RECORDS)
+            Commit();
+        else if (_config.sync == JournalSync::Batch && _group.size() % 32 == 0 // don't read the clock every time
+                 && std::chrono::steady_clock::now() - _groupStart >= std::chrono::microseconds(_config.groupCommitMicros))
+            Commit();
+    }
+
+    // makes everything appended so far as durable as the sync level promises
+    void Commit()
+    {
+        size_t done = 0;
+        while (done < _group.size())
+        {
+            size_t room = (_config.segmentBytes - _segmentBytes) / sizeof(BinaryCommand);
+            if (room == 0)
+            {
+                Sync();
+                close(_fd);
+                OpenSegment();
+                continue;
+            }
+            size_t count = std::min(room, _group.size() - done);
+            Write(reinterpret_cast<const char*>(_group.data() + done), count * sizeof(BinaryCommand));
+            _segmentBytes += count * sizeof(BinaryCommand);
+            _nextSequence += count;
+            done += count;
+        }
+        if (!_group.empty())
+        {
+            Sync();
+            ++_commits;
+        }
+        _group.clear();
+    }
+
+    uint64_t nextSequence() const { return _nextSequence + _group.size(); }
+    uint64_t commits() const { return _commits; }
+
+private:
+    // a journal which can't be written can't promise anything, so that's the end of the process
+    [[noreturn]] void Fail(const char* what)
+    {
+        perror(what);
+        std::exit(1);
+    }
+
+    void OpenSegment()
+    {
+        std::string path = JournalSegmentPath(_config.dir, _nextSequence);
+        _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0)
+            Fail(path.c_str());
+        // reserve the blocks up front but keep the size, so the file's length is still where the records end
+        fallocate(_fd, FALLOC_FL_KEEP_SIZE, 0, off_t(_config.segmentBytes));
+        BinaryFileHeader header = MakeBinaryHeader<BinaryCommand>(BinaryKind::Commands);
+        Write(reinterpret_cast<const char*>(&header), sizeof(header));
+        _segmentBytes = sizeof(header);
+
+        Sync();
+        int dirFd = open(_config.dir.c_str(), O_RDONLY | O_DIRECTORY); // and the new name in the directory
+        if (dirFd < 0 || fsync(dirFd) != 0)
+            Fail(_config.dir.c_str());
+        close(dirFd);
+    }
+
+    void Write(const char* data, size_t size)
+    {
+        while (size)
+        {
+            ssize_t written = write(_fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                Fail("journal write");
+            }
+            data += written;
+            size -= size_t(written);
+        }
+    }
+
+    void Sync()
+    {
+        if (_config.sync != JournalSync::None && fdatasync(_fd) != 0)
+            Fail("journal fdatasync");
+    }
+
+    JournalConfig _config;
+    uint64_t _nextSequence; // of the first record in _group
+    std::vector<BinaryCommand> _group;
+    std::chrono::steady_clock::time_point _groupStart;
+    int _fd = -1;
+    size_t _segmentBytes = 0; // written to the current segment so far, header included
+    uint64_t _commits = 0;
+};
+
+// calls onCommand for every journaled command from sequence number fromSequence on, and sets endSequence
+// to one past the last one. a torn record at the very end (a crash mid-write) is ignored. false, with a
+// message on stderr, if the segments don't cover everything from fromSequence on without a gap
+template <typename OnCommand>
+bool ReplayJournal(const std::string& dir, uint64_t fromSequence, OnCommand&& onCommand, uint64_t& endSequence)
+{
+    std::vector<uint64_t> segments = ListJournalSegments(dir);
+    endSequence = fromSequence;
+    if (segments.empty())
+        return true; // nothing was journaled after the snapshot
+    if (segments.front() > fromSequence)
+    {
+        fprintf(stderr, "%s: journal starts at %" PRIu64 ", after %" PRIu64 "\n", dir.c_str(), segments.front(), fromSequence);
+        return false;
+    }
+    for (size_t ii = 0; ii < segments.size(); ++ii)
+    {
+        if (ii + 1 < segments.size() && segments[ii + 1] <= fromSequence)
+            continue; // entirely before the snapshot
+        if (segments[ii] > endSequence)
+        {
+            fprintf(stderr, "%s: journal is missing %" PRIu64 " to %" PRIu64 "\n", dir.c_str(), endSequence, segments[ii]);
+            return false;
+        }
+        std::string path = JournalSegmentPath(dir, segments[ii]);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            perror(path.c_str());
+            return false;
+        }
+        InputReader reader(fd);
+        uint64_t sequence = segments[ii];
+        bool ok = ReadBinary(reader, [&](const Command& cmd)
+                             {
+                                 if (sequence++ >= fromSequence)
+                                     onCommand(cmd);
+                             },
+                             [] {});
+        close(fd);
+        if (!ok && ii + 1 < segments.size()) // a segment cut short while its header was being written can only be the last
+        {
+            fprintf(stderr, "%s: not a journal segment\n", path.c_str());
+            return false;
+        }
+        endSequence = std::max(endSequence, sequence);
+    }
+    return true;
+}
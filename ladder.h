@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// flat price ladder: levels within a band of ticks are indexed directly by their offset from a base price,
+// and a hierarchical occupancy bitmap finds the best non-empty level with a few count-trailing-zeros.
+// prices which leave the band either re-center the ladder (if the live levels still fit in the band),
+// or fall back to an ordered map. a band of 0 is a plain std::map.
+
+// one bit per slot, plus a summary level per 64 words above it, so the first set bit is found in
+// ceil(log64(numBits)) word reads
+class OccupancyBitmap
+{
+public:
+    static constexpr size_t NONE = ~size_t(0);
+
+    explicit OccupancyBitmap(size_t numBits)
+    {
+        size_t numWords = numBits;
+        while (numWords > 1 || _levels.empty())
+        {
+            numWords = (numWords + 63) / 64;
+            _levels.emplace_back(numWords, 0);
+            if (numBits == 0)
+                break;
+        }
+    }
+
+    bool any() const { return !_levels.back().empty() && _levels.back()[0] != 0; }
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (const auto& words : _levels)
+            total += words.capacity() * sizeof(uint64_t);
+        return total;
+    }
+    bool test(size_t idx) const { return _levels[0][idx / 64] & (uint64_t(1) << (idx % 64)); }
+
+    void set(size_t idx)
+    {
+        for (auto& words : _levels)
+        {
+            uint64_t& word = words[idx / 64];
+            bool wasEmpty = word == 0;
+            word |= uint64_t(1) << (idx % 64);
+            if (!wasEmpty)
+                return; // summary bit above is already set
+            idx /= 64;
+        }
+    }
+
+    void reset(size_t idx)
+    {
+        for (auto& words : _levels)
+        {
+            uint64_t& word = words[idx / 64];
+            word &= ~(uint64_t(1) << (idx % 64));
+            if (word != 0)
+                return; // summary bit above must stay set
+            idx /= 64;
+        }
+    }
+
+    void clear()
+    {
+        for (auto& words : _levels)
+            std::fill(words.begin(), words.end(), 0);
+    }
+
+    // only valid if any()
+    size_t first() const
+    {
+        size_t idx = 0;
+        for (auto it = _levels.rbegin(); it != _levels.rend(); ++it)
+            idx = idx * 64 + std::countr_zero((*it)[idx]);
+        return idx;
+    }
+
+    // only valid if any()
+    size_t last() const
+    {
+        size_t idx = 0;
+        for (auto it = _levels.rbegin(); it != _levels.rend(); ++it)
+            idx = idx * 64 + 63 - std::countl_zero((*it)[idx]);
+        return idx;
+    }
+
+    // first set bit at or after idx, or NONE. climbs the summary levels until one has a bit past idx's
+    // word, then comes back down the way first() does
+    size_t next(size_t idx) const
+    {
+        size_t level = 0;
+        while (true)
+        {
+            if (level == _levels.size() || idx / 64 >= _levels[level].size())
+                return NONE;
+            uint64_t word = _levels[level][idx / 64] & (~uint64_t(0) << (idx % 64));
+            if (word)
+            {
+                idx = idx / 64 * 64 + std::countr_zero(word);
+                break;
+            }
+            idx = idx / 64 + 1;
+            ++level;
+        }
+        while (level-- > 0)
+            idx = idx * 64 + std::countr_zero(_levels[level][idx]);
+        return idx;
+    }
+
+    // calls fn(idx) for every set bit in ascending order
+    template <typename Fn>
+    void forEach(Fn&& fn) const
+    {
+        const std::vector<uint64_t>& leaves = _levels[0];
+        for (size_t ww = 0; ww < leaves.size(); ++ww)
+        {
+            for (uint64_t word = leaves[ww]; word; word &= word - 1)
+                fn(ww * 64 + std::countr_zero(word));
+        }
+    }
+
+private:
+    std::vector<std::vector<uint64_t>> _levels; // [0] is one bit per slot, back() is a single word
+};
+
+// Compare is std::greater<int32_t> for bids (best is highest) and std::less<int32_t> for asks (best is lowest).
+// slots are laid out so that index 0 is always the best price in the band, so both sides use first()
+template <typename Level, typename Compare, typename Alloc = std::allocator<std::pair<const int32_t, Level>>>
+class PriceLadder
+{
+public:
+    using allocator_type = Alloc;
+
+    explicit PriceLadder(size_t band = 0, const Alloc& alloc = Alloc())
+        : _levels(band)
+        , _occupied(band)
+        , _band(band)
+        , _outside(alloc)
+    {
+    }
+
+    bool empty() const { return !_occupied.any() && _outside.empty(); }
+    size_t size() const { return _size; } // levels
+    // the flat part, which is all there is to it until levels go out of band
+    size_t bandBytes() const { return _levels.capacity() * sizeof(Level) + _occupied.bytes(); }
+
+    Level& operator[](int32_t price) // construct if not exist
+    {
+        if (!InBand(price) && !Recenter(price))
+        {
+            auto [it, inserted] = _outside.try_emplace(price);
+            _size += inserted;
+            return it->second;
+        }
+        size_t idx = IndexOf(price);
+        _size += !_occupied.test(idx);
+        _occupied.set(idx);
+        return _levels[idx];
+    }
+
+    Level* find(int32_t price)
+    {
+        if (InBand(price))
+        {
+            size_t idx = IndexOf(price);
+            return _occupied.test(idx) ? &_levels[idx] : nullptr;
+        }
+        auto it = _outside.find(price);
+        return it != _outside.end() ? &it->second : nullptr;
+    }
+
+    void erase(int32_t price)
+    {
+        if (InBand(price))
+        {
+            size_t idx = IndexOf(price);
+            _size -= _occupied.test(idx);
+            _occupied.reset(idx); // the slot is kept for reuse, Market only erases levels once they're empty
+        }
+        else
+            _size -= _outside.erase(price);
+    }
+
+    // start pulling in price's slot, if it's in the band (the map is left alone)
+    void prefetch(int32_t price) const
+    {
+        if (InBand(price))
+            __builtin_prefetch(&_levels[IndexOf(price)]);
+    }
+
+    // best level and its price, or nullptr if this side is empty
+    Level* best(int32_t& price)
+    {
+        if (_occupied.any())
+        {
+            size_t idx = _occupied.first();
+            price = PriceOf(idx);
+            if (_outside.empty() || !Compare()(_outside.begin()->first, price))
+                return &_levels[idx];
+        }
+        if (_outside.empty())
+            return nullptr;
+        price = _outside.begin()->first;
+        return &_outside.begin()->second;
+    }
+
+    // fn(price, level) for the best levels, best first, for as long as it returns true. the band's bitmap
+    // and the map are each in order already, so this merges the two
+    template <typename Fn>
+    void forEachBestWhile(Fn&& fn)
+    {
+        size_t idx = _occupied.next(0);
+        auto it = _outside.begin();
+        while (true)
+        {
+            bool inBand = idx != OccupancyBitmap::NONE;
+            if (inBand && (it == _outside.end() || !Compare()(it->first, PriceOf(idx))))
+            {
+                if (!fn(PriceOf(idx), _levels[idx]))
+                    return;
+                idx = _occupied.next(idx + 1);
+            }
+            else if (it != _outside.end())
+            {
+                if (!fn(it->first, it->second))
+                    return;
+                ++it;
+            }
+            else
+                return;
+        }
+    }
+
+    // fn(price, level) for the best limit levels, best first
+    template <typename Fn>
+    void forEachBest(size_t limit, Fn&& fn)
+    {
+        if (limit == 0)
+            return;
+        forEachBestWhile([&](int32_t price, Level& level)
+                         {
+                             fn(price, level);
+                             return --limit > 0;
+                         });
+    }
+
+    // fn(price, level) for every level, in no particular order
+    template <typename Fn>
+    void forEach(Fn&& fn)
+    {
+        _occupied.forEach([&](size_t idx) { fn(PriceOf(idx), _levels[idx]); });
+        for (auto& [price, level] : _outside)
+            fn(price, level);
+    }
+
+private:
+    static constexpr bool IS_DESCENDING = std::is_same_v<Compare, std::greater<int32_t>>;
+
+    bool InBand(int32_t price) const { return price >= _low && int64_t(price) < _low + int64_t(_band); }
+
+    size_t IndexOf(int32_t price) const
+    {
+        if constexpr (IS_DESCENDING)
+            return size_t(_low + int64_t(_band) - 1 - price);
+        else
+            return size_t(price - _low);
+    }
+
+    int32_t PriceOf(size_t idx) const
+    {
+        if constexpr (IS_DESCENDING)
+            return int32_t(_low + int64_t(_band) - 1 - int64_t(idx));
+        else
+            return int32_t(_low + int64_t(idx));
+    }
+
+    // moves the band so that it covers price and every level currently in the band, centered on them.
+    // levels parked in the map which land inside the new band are pulled in. it's O(band), so it's only
+    // done when they span at most half the band, which leaves a quarter of it spare on either side for
+    // the next ones. returns false if they don't, and price's level goes in the map
+    bool Recenter(int32_t price)
+    {
+        if (_band == 0)
+            return false;
+        int64_t lo = price;
+        int64_t hi = price;
+        if (_occupied.any())
+        {
+            int64_t a = PriceOf(_occupied.first());
+            int64_t b = PriceOf(_occupied.last());
+            lo = std::min({lo, a, b});
+            hi = std::max({hi, a, b});
+        }
+        int64_t band = int64_t(_band);
+        if ((hi - lo + 1) * 2 > band && _occupied.any())
+            return false;
+
+        int64_t newLow = lo - (band - (hi - lo + 1)) / 2;
+        newLow = std::max(newLow, int64_t(std::numeric_limits<int32_t>::min()));
+        newLow = std::min(newLow, int64_t(std::numeric_limits<int32_t>::max()) - band + 1);
+
+        _occupied.forEach([&](size_t idx)
+                          {
+                              _recentered.emplace_back(PriceOf(idx), std::move(_levels[idx]));
+                              _levels[idx] = Level();
+                          });
+        _occupied.clear();
+        _low = newLow;
+        for (auto& [levelPrice, level] : _recentered)
+            Adopt(levelPrice, std::move(level));
+        _recentered.clear();
+
+        auto it = _outside.begin();
+        while (it != _outside.end())
+        {
+            if (InBand(it->first))
+            {
+                Adopt(it->first, std::move(it->second));
+                it = _outside.erase(it);
+            }
+            else
+                ++it;
+        }
+        return true;
+    }
+
+    void Adopt(int32_t price, Level&& level)
+    {
+        size_t idx = IndexOf(price);
+        _levels[idx] = std::move(level);
+        _occupied.set(idx);
+    }
+
+    std::vector<Level> _levels;
+    OccupancyBitmap _occupied;
+    size_t _band;
+    int64_t _low = 0; // lowest price in the band
+    size_t _size = 0;
+    std::map<int32_t, Level, Compare, Alloc> _outside;
+    std::vector<std::pair<int32_t, Level>> _recentered; // Recenter's scratch, kept for its capacity
+};
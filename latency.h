@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "command.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// per-message latency instrumentation, compiled in with -DTRADE_LATENCY (make trade-latency) and free
+// otherwise: every use is behind if constexpr (LATENCY_ENABLED), so without it nothing is read or
+// stored. timestamps come from the TSC, calibrated against steady_clock at startup, and go into HDR
+// style histograms per command type: a fixed array of log-linear buckets, so recording is a clz, a
+// shift and an increment, and never allocates.
+
+#ifdef TRADE_LATENCY
+constexpr bool LATENCY_ENABLED = true;
+#else
+constexpr bool LATENCY_ENABLED = false;
+#endif
+
+inline uint64_t ReadTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// TSC ticks per nanosecond, measured over a few ms
+inline double CalibrateTsc()
+{
+    auto wallStart = std::chrono::steady_clock::now();
+    uint64_t tscStart = ReadTsc();
+    while (std::chrono::steady_clock::now() - wallStart < std::chrono::milliseconds(10))
+        continue;
+    uint64_t tscEnd = ReadTsc();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wallStart).count();
+    return ns > 0 ? double(tscEnd - tscStart) / double(ns) : 1.0;
+}
+
+// values below 2^SUB_BITS get a bucket each, above that every power of two is split into 2^SUB_BITS
+// buckets, so any value is off by at most 1/32 of itself
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t value)
+    {
+        value = std::min(value, MAX_VALUE);
+        ++_buckets[BucketOf(value)];
+        ++_count;
+        _max = std::max(_max, value);
+    }
+
+    uint64_t count() const { return _count; }
+    uint64_t max() const { return _max; }
+
+    // highest value the q-th quantile's bucket stands for, q in [0, 1]
+    uint64_t Quantile(double q) const
+    {
+        if (_count == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(q * double(_count) + 0.5));
+        uint64_t seen = 0;
+        for (size_t idx = 0; idx < NUM_BUCKETS; ++idx)
+        {
+            seen += _buckets[idx];
+            if (seen >= rank)
+                return std::min(BucketTop(idx), _max);
+        }
+        return _max;
+    }
+
+private:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int MAX_BITS = 48; // days of TSC ticks, anything longer is clamped
+    static constexpr uint64_t MAX_VALUE = (uint64_t(1) << MAX_BITS) - 1;
+    static constexpr size_t NUM_BUCKETS = size_t(MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    static size_t BucketOf(uint64_t value)
+    {
+        if (value < (uint64_t(1) << SUB_BITS))
+            return size_t(value);
+        int shift = std::bit_width(value) - 1 - SUB_BITS;
+        return (size_t(shift + 1) << SUB_BITS) | size_t((value >> shift) & ((1 << SUB_BITS) - 1));
+    }
+
+    static uint64_t BucketTop(size_t idx)
+    {
+        if (idx < (size_t(1) << SUB_BITS))
+            return idx;
+        int shift = int(idx >> SUB_BITS) - 1;
+        uint64_t low = ((uint64_t(1) << SUB_BITS) | (idx & ((1 << SUB_BITS) - 1))) << shift;
+        return low + (uint64_t(1) << shift) - 1;
+    }
+
+    uint64_t _buckets[NUM_BUCKETS] = {};
+    uint64_t _count = 0;
+    uint64_t _max = 0;
+};
+
+// what the Market counts while matching one aggressive order
+struct MatchCounters
+{
+    uint32_t trades = 0;
+    uint32_t levelsSwept = 0; // passive levels it emptied
+};
+
+// set by SIGUSR1, the probe dumps at the next command it sees
+inline volatile std::sig_atomic_t latencyDumpRequested = 0;
+
+inline void RequestLatencyDump(int) { latencyDumpRequested = 1; }
+
+// stamps each command when its parse starts (the previous command is done, or the input batch began),
+// when matching starts and ends, and when the output is flushed after its batch
+class LatencyProbe
+{
+public:
+    LatencyProbe()
+        : _ticksPerNs(CalibrateTsc())
+    {
+        _pending.reserve(MAX_PENDING);
+        std::signal(SIGUSR1, RequestLatencyDump);
+        _mark = ReadTsc();
+    }
+
+    void MatchStart(CommandType type)
+    {
+        uint64_t now = ReadTsc();
+        _type = TypeIndex(type);
+        _stages[_type][PARSE].Record(now - _mark);
+        if (_pending.size() < MAX_PENDING)
+            _pending.push_back(Pending{_mark, _type});
+        _matchStart = now;
+    }
+
+    void MatchEnd(const MatchCounters& counters)
+    {
+        uint64_t now = ReadTsc();
+        _stages[_type][MATCH].Record(now - _matchStart);
+        if (counters.trades)
+        {
+            _tradesPerAggressor.Record(counters.trades);
+            _levelsSwept.Record(counters.levelsSwept);
+        }
+        if (latencyDumpRequested)
+        {
+            latencyDumpRequested = 0;
+            Dump(stderr);
+        }
+        _mark = ReadTsc();
+    }
+
+    void Flushed()
+    {
+        uint64_t now = ReadTsc();
+        for (const Pending& pending : _pending)
+            _stages[pending.type][TO_FLUSH].Record(now - pending.parseStart);
+        _pending.clear();
+        _mark = ReadTsc();
+    }
+
+    void Dump(FILE* out) const
+    {
+        static constexpr const char* TYPE_NAMES[NUM_TYPES] = {"BUY", "SELL", "REVISE", "CANCEL", "DEPTH", "IOC BUY",
+                                                              "IOC SELL", "FOK BUY", "FOK SELL", "MARKET BUY", "MARKET SELL",
+                                                              "STATS", "INVALID"};
+        static constexpr const char* STAGE_NAMES[NUM_STAGES] = {"parse", "match", "to flush"};
+        fprintf(out, "%-22s %10s %8s %8s %8s %8s %8s %10s   (ns)\n", "", "count", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+        for (size_t type = 0; type < NUM_TYPES; ++type)
+        {
+            for (size_t stage = 0; stage < NUM_STAGES; ++stage)
+            {
+                if (_stages[type][stage].count())
+                    Row(out, std::string(TYPE_NAMES[type]) + " " + STAGE_NAMES[stage], _stages[type][stage], _ticksPerNs);
+            }
+        }
+        Row(out, "trades/aggressor", _tradesPerAggressor, 1.0);
+        Row(out, "levels swept", _levelsSwept, 1.0);
+        fflush(out);
+    }
+
+private:
+    enum Stage
+    {
+        PARSE,
+        MATCH,
+        TO_FLUSH,
+        NUM_STAGES
+    };
+
+    static constexpr size_t NUM_TYPES = 13; // Buy to Invalid
+    static constexpr size_t MAX_PENDING = 1024 * 1024; // commands after this many in one batch aren't timed to the flush
+
+    struct Pending
+    {
+        uint64_t parseStart;
+        uint8_t type;
+    };
+
+    static uint8_t TypeIndex(CommandType type) { return std::min(uint8_t(type), uint8_t(NUM_TYPES - 1)); }
+
+    static void Row(FILE* out, const std::string& name, const LatencyHistogram& histogram, double ticksPerNs)
+    {
+        auto scaled = [&](uint64_t ticks) { return (unsigned long long)(double(ticks) / ticksPerNs); };
+        fprintf(out, "%-22s %10llu %8llu %8llu %8llu %8llu %8llu %10llu\n", name.c_str(), (unsigned long long)histogram.count(),
+                scaled(histogram.Quantile(0.5)), scaled(histogram.Quantile(0.9)), scaled(histogram.Quantile(0.99)),
+                scaled(histogram.Quantile(0.999)), scaled(histogram.Quantile(0.9999)), scaled(histogram.max()));
+    }
+
+    double _ticksPerNs;
+    uint64_t _mark; // when the command being parsed now started
+    uint64_t _matchStart = 0;
+    uint8_t _type = 0;
+    std::vector<Pending> _pending; // parsed since the last flush
+    LatencyHistogram _stages[NUM_TYPES][NUM_STAGES];
+    LatencyHistogram _tradesPerAggressor;
+    LatencyHistogram _levelsSwept;
+};
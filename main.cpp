@@ -1,222 +1,404 @@
 #include <cstdio>
 #include <cstdint>
-#include <iostream>
-#include <unordered_map>
-#include <map>
-#include <deque>
-#include <algorithm>
-#include <limits>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.h"
+#include "frontend.h"
+#include "journal.h"
+#include "latency.h"
+#include "market.h"
+#include "pipeline.h"
+#include "protocol.h"
+#include "reader.h"
+#include "replay.h"
+#include "router.h"
+#include "snapshot.h"
+#include "sink.h"
+#include "statsdump.h"
 
 // input format:
-// <ORDER ID> <BUY | SELL> <QTY> <PRICE>
-// <ORDER ID> REVISE <QTY> <PRICE>
-// <ORDER ID> CANCEL
+// <ORDER ID> <BUY | SELL> <QTY> <PRICE> [SYMBOL]
+// <ORDER ID> REVISE <QTY> <PRICE> [SYMBOL]
+// <ORDER ID> CANCEL [SYMBOL]
+// <REQUEST ID> DEPTH <LEVELS> [SYMBOL]
+// <ORDER ID> <IOC | FOK> <BUY | SELL> <QTY> <PRICE> [SYMBOL]
+// <ORDER ID> MARKET <BUY | SELL> <QTY> [SYMBOL]
+// <REQUEST ID> STATS [SYMBOL]
+// the symbol is only looked at with --threads, which runs one book per symbol with order ids per book.
+// there, output messages for a named symbol end with " <SYMBOL>" too
+// input ends at an order id which isn't a number. a sign in front of one is taken, and a minus wraps it
+// around, as std::cin did. a qty, price or level count which isn't a number (or doesn't fit in 32 bits) ends
+// it after that command, which goes ahead with the field as 0 (or clamped) and the ones after it as 0, as
+// std::cin left them. except that std::cin kept the previous command's value in the fields after the bad one
+
+// --snapshot <file> writes the book to file on SIGUSR2 and at the end of the input, and --restore <file>
+// starts from one, skipping the input it had already processed
+
+// --journal <dir> appends every command to a write-ahead journal before matching it (see journal.h), and
+// --recover replays the journal on top of the --restore snapshot (or an empty book) without output, then
+// skips the input commands the journal already had
+
+// --depth-updates follows every command's output with a DEPTH line for each price level it changed, giving
+// the level's total qty and order count after the command (0 0 once it's empty). DEPTH answers with BOOK,
+// then a LEVEL line for each of the best <LEVELS> levels per side, bids first and best first
+
+// a REVISE is a cancel and a new order, so it goes to the back of its level and its output is CANCEL then
+// BUY or SELL. with --amend, one that keeps the price and lowers the qty is done in place instead: the
+// order keeps its place in the queue, nothing is matched, and the output is a single REVISE line. since
+// that changes the book, --recover needs --amend if the journal was written with it
+
+// IOC, FOK and MARKET orders never rest. IOC trades what it can at its price or better and cancels the
+// rest, FOK does the same only if it can fill completely and otherwise cancels all of it, and MARKET is an
+// IOC without a price. each is echoed, followed by its trades and then a CANCEL for what didn't fill
+
+// --replay <out dir> takes any number of input files or directories of them instead of one, and runs each
+// file through its own book into <out dir>/<file name>.out on --jobs worker threads (one per hardware
+// thread by default), then prints the throughput. see replay.h
+
+// STATS answers with the book's counters, size and memory (see stats.h): a STATS line with how many STAT
+// lines follow, then one per value. --stats-file <file> also has them rewritten into file every
+// --stats-interval-ms (1000 by default) by a thread of its own, as of the last finished input run
+
+// --listen <socket> serves any number of gateways on a Unix domain socket instead, each sending commands
+// and getting back the output of its own, plus every TRADE (and DEPTH with --depth-updates), all from one
+// book. --fifo <in>,<out> adds a session on a pair of FIFOs, and can be given more than once. see frontend.h
+
+// --pipeline splits parsing, matching and output formatting over three threads, output stays the same
 
 // output messages:
 // <BUY | SELL> <QTY> <PRICE> <ORDER ID>
 // REVISE <QTY> <PRICE> <ORDER ID>
 // CANCEL <ORDER ID> <QTY>
+// <IOC | FOK> <BUY | SELL> <QTY> <PRICE> <ORDER ID>
+// MARKET <BUY | SELL> <QTY> <ORDER ID>
 // TRADE <AGGRESSIVE ID> <PASSIVE ID> <QTY> <PRICE>
+// DEPTH <BID | ASK> <PRICE> <TOTAL QTY> <ORDERS>
+// BOOK <REQUEST ID> <BID LEVELS> <ASK LEVELS>
+// LEVEL <BID | ASK> <PRICE> <TOTAL QTY> <ORDERS>
+// STATS <REQUEST ID> <COUNT>
+// STAT <NAME> <VALUE>
 
-struct Order
-{
-    Order(uint64_t o, int32_t p, int32_t q) : orderId(o), price(p), qty(q) {}
-    uint64_t orderId;
-    int32_t price;
-    int32_t qty;
-};
-
-struct SideLevel
-{
-    SideLevel() = default;
-    SideLevel(bool ib, int32_t p) : isBuy(ib), price(p) {}
-    bool isBuy;
-    int32_t price;
-};
-
-using LevelQueue = std::deque<Order>;
-
-struct Market
+int main(int argc, char** argv)
 {
-    void AddOrder(uint64_t orderId, bool isBuy, int32_t qty, int32_t price)
+    MarketConfig config;
+    std::vector<std::string> inputPaths; // stdin if none, only --replay takes more than one
+    bool nullOutput = false;
+    bool binaryIn = false;
+    bool binaryOut = false;
+    size_t numThreads = 0; // one book for everything
+    bool pipelined = false;
+    const char* snapshotPath = nullptr;
+    const char* restorePath = nullptr;
+    JournalConfig journalConfig;
+    bool recover = false;
+    PipelineConfig pipelineConfig;
+    const char* statsPath = nullptr;
+    unsigned statsIntervalMs = 1000;
+    const char* listenPath = nullptr;
+    std::vector<std::pair<std::string, std::string>> fifoPaths;
+    bool replay = false;
+    ReplayConfig replayConfig;
+    for (int ii = 1; ii < argc; ++ii)
     {
-        // printf("DEBUG AddOrder: orderId=%lu isBuy=%d qty=%d price=%d\n", orderId, isBuy, qty, price);
-        LevelQueue* levelQueue;
-        if (isBuy)
-            levelQueue = &_bidLevels[price]; // construct if not exist
+        std::string arg = argv[ii];
+        if (arg == "--ladder" && ii + 1 < argc)
+            config.ladderBand = std::stoul(argv[++ii]);
+        else if (arg == "--reserve" && ii + 1 < argc)
+            config.reserveOrders = std::stoul(argv[++ii]);
+        else if (arg == "--hashed-ids")
+            config.directIds = false;
+        else if (arg == "--depth-updates")
+            config.depthUpdates = true;
+        else if (arg == "--amend")
+            config.amendInPlace = true;
+        else if (arg == "--prefault")
+            config.poolPrefault = true;
+        else if (arg == "--null-output")
+            nullOutput = true;
+        else if (arg == "--binary-in")
+            binaryIn = true;
+        else if (arg == "--binary-out")
+            binaryOut = true;
+        else if (arg == "--threads" && ii + 1 < argc)
+            numThreads = std::stoul(argv[++ii]);
+        else if (arg == "--snapshot" && ii + 1 < argc)
+            snapshotPath = argv[++ii];
+        else if (arg == "--restore" && ii + 1 < argc)
+            restorePath = argv[++ii];
+        else if (arg == "--journal" && ii + 1 < argc)
+            journalConfig.dir = argv[++ii];
+        else if (arg == "--journal-sync" && ii + 1 < argc && ParseJournalSync(argv[ii + 1], journalConfig.sync))
+            ++ii;
+        else if (arg == "--group-commit-us" && ii + 1 < argc)
+            journalConfig.groupCommitMicros = std::stoull(argv[++ii]);
+        else if (arg == "--journal-segment-mb" && ii + 1 < argc)
+            journalConfig.segmentBytes = std::stoull(argv[++ii]) * 1024 * 1024;
+        else if (arg == "--stats-file" && ii + 1 < argc)
+            statsPath = argv[++ii];
+        else if (arg == "--stats-interval-ms" && ii + 1 < argc)
+            statsIntervalMs = std::max(1u, unsigned(std::stoul(argv[++ii])));
+        else if (arg == "--recover")
+            recover = true;
+        else if (arg == "--pipeline")
+            pipelined = true;
+        else if (arg == "--spin")
+            pipelineConfig.backOff = BackOff::Spin;
+        else if (arg == "--pin" && ii + 1 < argc)
+        {
+            PipelineConfig& pc = pipelineConfig;
+            if (sscanf(argv[++ii], "%d,%d,%d", &pc.parseCpu, &pc.matchCpu, &pc.publishCpu) != 3)
+            {
+                fprintf(stderr, "--pin wants three cpu numbers, like 0,2,4\n");
+                return 1;
+            }
+        }
+        else if (arg == "--replay" && ii + 1 < argc)
+        {
+            replay = true;
+            replayConfig.outDir = argv[++ii];
+        }
+        else if (arg == "--listen" && ii + 1 < argc)
+            listenPath = argv[++ii];
+        else if (arg == "--fifo" && ii + 1 < argc && std::strchr(argv[ii + 1], ','))
+        {
+            std::string paths = argv[++ii];
+            size_t comma = paths.find(',');
+            fifoPaths.emplace_back(paths.substr(0, comma), paths.substr(comma + 1));
+        }
+        else if (arg == "--jobs" && ii + 1 < argc)
+            replayConfig.numWorkers = std::stoul(argv[++ii]);
+        else if (arg[0] != '-')
+            inputPaths.push_back(argv[ii]);
         else
-            levelQueue = &_askLevels[price];
-        levelQueue->emplace_back(orderId, price, qty);
-        auto sideLevel = SideLevel(isBuy, price);
-        _idToSideLevel[orderId] = sideLevel;
-
-        const char* side = isBuy ? "BUY" : "SELL";
-        printf("%s %d %d %lu\n", side, qty, price, orderId);
-
-        MatchOrders(isBuy);
-    }
-
-    void ReviseOrder(uint64_t orderId, int32_t qty, int32_t price)
-    {
-        // printf("DEBUG ReviseOrder: orderId=%lu qty=%d price=%d\n", orderId, qty, price);
-        auto it = _idToSideLevel.find(orderId);
-        if (it != _idToSideLevel.end())
         {
-            SideLevel& sideLevel = it->second;
-            CancelOrder(sideLevel, orderId);
-            AddOrder(orderId, sideLevel.isBuy, qty, price);
-            sideLevel.price = price; // cannot change side with revise
+            fprintf(stderr, "usage: %s [--ladder <ticks per side, 0 for map only>] [--reserve <orders>] [--prefault] [--hashed-ids]\n"
+                            "          [--depth-updates] [--amend] [--binary-in] [--binary-out | --null-output] [--threads <workers>]\n"
+                            "          [--pipeline [--spin] [--pin <parse cpu>,<match cpu>,<publish cpu>]]\n"
+                            "          [--snapshot <file>] [--restore <file>] [--stats-file <file> [--stats-interval-ms <ms>]]\n"
+                            "          [--journal <dir> [--recover]\n"
+                            "          [--journal-sync none|batch|every] [--group-commit-us <us>] [--journal-segment-mb <mb>]]\n"
+                            "          [input file]\n"
+                            "       %s --listen <socket> | --fifo <in fifo>,<out fifo> ... [--ladder, --amend etc. as above]\n"
+                            "       %s --replay <out dir> [--jobs <workers>] [--ladder, --amend etc. as above]\n"
+                            "          [--binary-in] [--binary-out | --null-output] <input files or directories>...\n", argv[0], argv[0], argv[0]);
+            return 1;
         }
     }
-
-    void CancelOrder(SideLevel sideLevel, uint64_t orderId)
+    bool journaled = !journalConfig.dir.empty();
+    if (listenPath || !fifoPaths.empty())
     {
-        LevelQueue* levelQueue = nullptr;
-        if (sideLevel.isBuy)
+        if (replay || numThreads || pipelined || snapshotPath || restorePath || journaled || statsPath || binaryIn
+            || binaryOut || nullOutput || !inputPaths.empty())
         {
-            auto bidLevelIt = _bidLevels.find(sideLevel.price);
-            if (bidLevelIt != _bidLevels.end())
-                levelQueue = &bidLevelIt->second;
+            fprintf(stderr, "--listen and --fifo only go with the book options, the sessions are the input and output\n");
+            return 1;
         }
-        else
+        SessionFrontend frontend(config);
+        if (listenPath && !frontend.Listen(listenPath))
+            return 1;
+        for (const auto& [inPath, outPath] : fifoPaths)
         {
-            auto askLevelIt = _askLevels.find(sideLevel.price);
-            if (askLevelIt != _askLevels.end())
-                levelQueue = &askLevelIt->second;
+            if (!frontend.AddFifoSession(inPath, outPath))
+                return 1;
         }
-        if (!levelQueue)
-            return; // should never happen
-        auto orderIt = std::find_if(levelQueue->begin(), levelQueue->end(), [orderId](const Order& order)
-                                    {
-                                        return order.orderId == orderId;
-                                    });
-        int32_t qtyCancelled = orderIt->qty;
-        levelQueue->erase(orderIt);
-        printf("CANCEL %lu %d\n", orderId, qtyCancelled);
-    }
-
-    void CancelOrder(uint64_t orderId)
-    {
-        // printf("DEBUG CancelOrder: orderId=%lu\n", orderId);
-        auto it = _idToSideLevel.find(orderId);
-        if (it != _idToSideLevel.end())
+        return frontend.Run() ? 0 : 1;
+    }
+    if (replay)
+    {
+        if (numThreads || pipelined || snapshotPath || restorePath || journaled || statsPath || inputPaths.empty())
         {
-            SideLevel sideLevel = it->second;
-            CancelOrder(sideLevel, orderId);
-            _idToSideLevel.erase(it);
+            fprintf(stderr, "--replay needs input files, and only goes with --jobs and the book and input/output options\n");
+            return 1;
         }
+        replayConfig.binaryIn = binaryIn;
+        replayConfig.binaryOut = binaryOut;
+        replayConfig.nullOutput = nullOutput;
+        FileReplay fileReplay(config, replayConfig);
+        return fileReplay.Run(inputPaths) ? 0 : 1;
     }
-
-    void MatchOrders(bool aggressorIsBuy)
+    if (inputPaths.size() > 1)
     {
-        // match all orders which can match and print them
-        while (TryMatchBests(aggressorIsBuy))
-            continue;
+        fprintf(stderr, "more than one input file needs --replay\n");
+        return 1;
     }
-
-    bool TryMatchBests(bool aggressorIsBuy)
+    if (numThreads && (binaryIn || binaryOut))
     {
-        auto bestBidLevelIt = _bidLevels.begin();
-        auto bestAskLevelIt = _askLevels.begin();
-        if (bestBidLevelIt == _bidLevels.end())
-            return false;
-        if (bestAskLevelIt == _askLevels.end())
-            return false;
-        int32_t bestBidPrice = bestBidLevelIt->first;
-        int32_t bestAskPrice = bestAskLevelIt->first;
-        if (bestBidPrice < bestAskPrice)
-            return false;
+        fprintf(stderr, "--threads only speaks the text protocol\n");
+        return 1;
+    }
+    if (numThreads && pipelined)
+    {
+        fprintf(stderr, "--threads and --pipeline don't go together\n");
+        return 1;
+    }
+    if ((numThreads || pipelined) && (snapshotPath || restorePath || journaled || statsPath))
+    {
+        fprintf(stderr, "--snapshot, --restore, --journal and --stats-file only work with a single book and no --pipeline\n");
+        return 1;
+    }
+    if (recover && !journaled)
+    {
+        fprintf(stderr, "--recover needs the --journal to recover from\n");
+        return 1;
+    }
+    if (journaled && !recover && !ListJournalSegments(journalConfig.dir).empty())
+    {
+        fprintf(stderr, "%s already has a journal, --recover from it or move it away\n", journalConfig.dir.c_str());
+        return 1;
+    }
 
-        // else, we can match
-        LevelQueue& bestBidQueue = bestBidLevelIt->second;
-        LevelQueue& bestAskQueue = bestAskLevelIt->second;
-        Order& bestBidFrontOrder = bestBidQueue.front();
-        Order& bestAskFrontOrder = bestAskQueue.front();
-        uint64_t aggrId = aggressorIsBuy ? bestBidFrontOrder.orderId : bestAskFrontOrder.orderId;
-        uint64_t passiveId = aggressorIsBuy ? bestAskFrontOrder.orderId : bestBidFrontOrder.orderId;
-        int32_t tradePrice = aggressorIsBuy ? bestAskFrontOrder.price : bestBidFrontOrder.price;
-        if (bestBidFrontOrder.qty > bestAskFrontOrder.qty)
+    int fd = STDIN_FILENO;
+    if (!inputPaths.empty())
+    {
+        fd = open(inputPaths[0].c_str(), O_RDONLY);
+        if (fd < 0)
         {
-            int32_t tradeQty = bestAskFrontOrder.qty;
-            bestBidFrontOrder.qty -= tradeQty;
-            uint64_t idToDelete = bestAskFrontOrder.orderId;
-            bestAskQueue.pop_front();
-            _idToSideLevel.erase(idToDelete);
-            printf("TRADE %lu %lu %d %d\n", aggrId, passiveId, tradeQty, tradePrice);
+            perror(inputPaths[0].c_str());
+            return 1;
         }
-        else if (bestBidFrontOrder.qty < bestAskFrontOrder.qty)
+    }
+    InputReader reader(fd);
+    if (numThreads)
+    {
+        SymbolRouter router(numThreads, config, nullOutput ? -1 : STDOUT_FILENO);
+        router.Run(reader);
+        return 0;
+    }
+
+    std::unique_ptr<EventSink> sink;
+    if (nullOutput)
+        sink = std::make_unique<NullSink>();
+    else if (binaryOut)
+        sink = std::make_unique<BinarySink>(STDOUT_FILENO);
+    else
+        sink = std::make_unique<BufferedSink>(STDOUT_FILENO);
+    if (pipelined)
+    {
+        Pipeline pipeline(*sink, config, pipelineConfig);
+        if (!pipeline.Run(reader, binaryIn))
         {
-            int32_t tradeQty = bestBidFrontOrder.qty;
-            bestAskFrontOrder.qty -= tradeQty;
-            uint64_t idToDelete = bestBidFrontOrder.orderId;
-            bestBidQueue.pop_front();
-            _idToSideLevel.erase(idToDelete);
-            printf("TRADE %lu %lu %d %d\n", aggrId, passiveId, tradeQty, tradePrice);
+            fprintf(stderr, "input is not a version %u binary command file\n", unsigned(BINARY_VERSION));
+            return 1;
         }
-        else // they're equal
+        return 0;
+    }
+
+    Market market(*sink, config);
+    SnapshotPosition position;
+    if (restorePath)
+    {
+        if (!LoadSnapshot(market, restorePath, position))
+            return 1;
+        if (!binaryIn && !reader.skip(position.inputOffset))
         {
-            int32_t tradeQty = bestBidFrontOrder.qty; // bid and ask qty same anyway
-            bestBidQueue.pop_front();
-            bestAskQueue.pop_front();
-            _idToSideLevel.erase(bestBidFrontOrder.orderId);
-            _idToSideLevel.erase(bestAskFrontOrder.orderId);
-            printf("TRADE %lu %lu %d %d\n", aggrId, passiveId, tradeQty, tradePrice);
+            fprintf(stderr, "input ends before the snapshot's offset %llu\n", (unsigned long long)position.inputOffset);
+            return 1;
         }
-        if (bestAskQueue.empty())
-            _askLevels.erase(bestAskLevelIt);
-        if (bestBidQueue.empty())
-            _bidLevels.erase(bestBidLevelIt);
-        return true;
-        // TRADE <AGGRESSIVE ID> <PASSIVE ID> <QTY> <PRICE>
     }
+    uint64_t skipCommands = 0; // already in the journal
+    if (recover)
+    {
+        NullSink replaySink;
+        market.SetSink(replaySink);
+        uint64_t endSequence;
+        if (!ReplayJournal(journalConfig.dir, position.sequence, [&](const Command& cmd) { market.Process(cmd); }, endSequence))
+            return 1;
+        market.SetSink(*sink);
+        skipCommands = endSequence - position.sequence;
+        position.sequence = endSequence;
+    }
+    std::unique_ptr<Journal> journal;
+    if (journaled)
+        journal = std::make_unique<Journal>(journalConfig, position.sequence);
+    if (snapshotPath)
+        signal(SIGUSR2, RequestSnapshot);
+    auto snapshot = [&]
+    {
+        position.inputOffset = reader.position();
+        if (!WriteSnapshot(market, snapshotPath, position))
+            perror(snapshotPath);
+    };
 
-    std::unordered_map<uint64_t, SideLevel> _idToSideLevel;
-
-    // bid levels are in descending order, front is best/highest
-    std::map<int32_t, LevelQueue, std::greater<int32_t>> _bidLevels;
-    // ask levels are in ascending order, front is best/lowest
-    std::map<int32_t, LevelQueue> _askLevels;
-};
-
-int main()
-{
-    using namespace std;
-    Market market;
+    // declared after the Market, so the dumper's last dump is done before it goes
+    StatsBoard statsBoard;
+    std::unique_ptr<StatsDumper> statsDumper;
+    if (statsPath)
+    {
+        statsBoard.Publish(market.Stats());
+        statsDumper = std::make_unique<StatsDumper>(statsPath, std::chrono::milliseconds(statsIntervalMs), statsBoard);
+    }
 
-    uint64_t orderId;
-    int32_t price;
-    int32_t qty;
-    std::string command;
-    while (std::cin >> orderId)
+    std::unique_ptr<LatencyProbe> probe;
+    if constexpr (LATENCY_ENABLED)
+        probe = std::make_unique<LatencyProbe>();
+    auto match = [&](const Command& cmd)
+    {
+        if constexpr (LATENCY_ENABLED)
+            probe->MatchStart(cmd.type);
+        market.Process(cmd);
+        if constexpr (LATENCY_ENABLED)
+            probe->MatchEnd(market.TakeMatchCounters());
+    };
+    // with a journal an input run is only matched once it's committed, since a run's output can outgrow the
+    // sink's buffer and go out before the flush. it's held anyway, so it goes through ProcessBatch
+    std::vector<Command> uncommitted;
+    auto process = [&](const Command& cmd)
     {
-        std::cin >> command;
-        if (command == "BUY")
+        if (skipCommands)
+        {
+            --skipCommands;
+            return;
+        }
+        ++position.sequence;
+        if (journal)
         {
-            std::cin >> qty;
-            std::cin >> price;
-            market.AddOrder(orderId, true, qty, price);
-            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            journal->Append(cmd);
+            uncommitted.push_back(cmd);
         }
-        else if (command == "SELL")
+        else
+            match(cmd);
+    };
+    auto flush = [&]
+    {
+        if (journal)
         {
-            std::cin >> qty;
-            std::cin >> price;
-            market.AddOrder(orderId, false, qty, price);
-            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            journal->Commit(); // the run's commands are durable before any of its output goes out
+            if constexpr (LATENCY_ENABLED)
+            {
+                for (const Command& cmd : uncommitted)
+                    match(cmd);
+            }
+            else
+                market.ProcessBatch(uncommitted);
+            uncommitted.clear();
         }
-        else if (command == "REVISE")
+        if (statsDumper)
+            statsBoard.Publish(market.Stats());
+        sink->Flush();
+        if constexpr (LATENCY_ENABLED)
+            probe->Flushed();
+        if (snapshotPath && snapshotRequested) // between runs, where the input offset is exact
         {
-            std::cin >> qty;
-            std::cin >> price;
-            market.ReviseOrder(orderId, qty, price);
-            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            snapshotRequested = 0;
+            snapshot();
         }
-        else if (command == "CANCEL")
+    };
+    if (binaryIn)
+    {
+        if (!ReadBinary(reader, process, flush, position.inputOffset))
         {
-            market.CancelOrder(orderId);
-            std::cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            fprintf(stderr, "input is not a version %u binary command file\n", unsigned(BINARY_VERSION));
+            return 1;
         }
-        else
-            printf("could not parse command\n");
     }
+    else
+        ReadText(reader, process, flush);
+    flush();
+    if (snapshotPath)
+        snapshot();
+    if constexpr (LATENCY_ENABLED)
+        probe->Dump(stderr);
 }
@@ -0,0 +1,785 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "command.h"
+#include "darray.h"
+#include "idindex.h"
+#include "ladder.h"
+#include "latency.h"
+#include "pool.h"
+#include "protocol.h"
+#include "sink.h"
+#include "stats.h"
+
+// one order book. the protocol it speaks is described at the top of main.cpp
+
+struct Order
+{
+    Order(uint64_t o, int32_t p, int32_t q) : orderId(o), price(p), qty(q) {}
+    uint64_t orderId;
+    int32_t price;
+    int32_t qty;
+    Order* prev = nullptr; // neighbours in a ListLevelQueue, nullptr at either end
+    Order* next = nullptr;
+};
+
+struct SideLevel
+{
+    SideLevel() = default;
+    SideLevel(bool ib, int32_t p, Order* o) : isBuy(ib), price(p), order(o) {}
+    bool isBuy;
+    int32_t price;
+    Order* order; // handle on the resting order, allocated from the Market's pool
+};
+
+// the orders resting at one price, oldest first. either queue only holds them, the Market owns their
+// memory, so a handle stays valid until the order is popped or erased. both also keep the level's total
+// qty and order count up to date, so depth is read off the level rather than summed over its orders.
+
+// intrusive doubly-linked fifo, the default. removing any order is an unlink which never scans or shifts
+class ListLevelQueue
+{
+public:
+    bool empty() const { return _head == nullptr; }
+    Order& front() { return *_head; }
+    int64_t totalQty() const { return _totalQty; }
+    uint32_t orderCount() const { return _orderCount; }
+
+    void push_back(Order* order)
+    {
+        _totalQty += order->qty;
+        ++_orderCount;
+        order->prev = _tail;
+        order->next = nullptr;
+        if (_tail)
+            _tail->next = order;
+        else
+            _head = order;
+        _tail = order;
+    }
+
+    void pop_front() { erase(_head); }
+
+    void erase(Order* order) // order must be in this queue
+    {
+        _totalQty -= order->qty;
+        --_orderCount;
+        if (order->prev)
+            order->prev->next = order->next;
+        else
+            _head = order->next;
+        if (order->next)
+            order->next->prev = order->prev;
+        else
+            _tail = order->prev;
+    }
+
+    // a partial fill of order, which stays where it is
+    void reduce(Order& order, int32_t qty)
+    {
+        order.qty -= qty;
+        _totalQty -= qty;
+    }
+
+    // fn(order) front to back
+    template <typename Fn>
+    void forEach(Fn&& fn)
+    {
+        for (Order* order = _head; order; order = order->next)
+            fn(*order);
+    }
+
+    // fn(order) front to back, leaving the queue empty. fn may free the order
+    template <typename Fn>
+    void drain(Fn&& fn)
+    {
+        for (Order* order = _head; order;)
+        {
+            Order* next = order->next;
+            fn(*order);
+            order = next;
+        }
+        _head = _tail = nullptr;
+        _totalQty = 0;
+        _orderCount = 0;
+    }
+
+private:
+    Order* _head = nullptr;
+    Order* _tail = nullptr;
+    int64_t _totalQty = 0;
+    uint32_t _orderCount = 0;
+};
+
+constexpr size_t RING_LEVEL_INLINE_ORDERS = 4;
+
+// ring buffer of order pointers in a small_vector, so a level of up to RING_LEVEL_INLINE_ORDERS orders
+// allocates nothing and its handles sit next to the totals. pop_front is O(1), erasing from the middle
+// scans for the order and closes the gap, which is cheap while levels are shallow. build with
+// -DTRADE_RING_LEVELS to use it (make bench-ring)
+class RingLevelQueue
+{
+public:
+    RingLevelQueue() { _slots.resize(RING_LEVEL_INLINE_ORDERS); } // on the inline slots, no allocation
+
+    bool empty() const { return _count == 0; }
+    Order& front() { return *_slots[_first]; }
+    int64_t totalQty() const { return _totalQty; }
+    uint32_t orderCount() const { return _count; }
+
+    void push_back(Order* order)
+    {
+        if (_count == _slots.size())
+            Grow();
+        _slots[Slot(_count)] = order;
+        ++_count;
+        _totalQty += order->qty;
+    }
+
+    void pop_front()
+    {
+        _totalQty -= _slots[_first]->qty;
+        _first = Slot(1);
+        --_count;
+    }
+
+    void erase(Order* order) // order must be in this queue
+    {
+        uint32_t pos = 0;
+        while (_slots[Slot(pos)] != order)
+            ++pos;
+        if (pos == 0)
+        {
+            pop_front();
+            return;
+        }
+        _totalQty -= order->qty;
+        for (--_count; pos < _count; ++pos)
+            _slots[Slot(pos)] = _slots[Slot(pos + 1)];
+    }
+
+    void reduce(Order& order, int32_t qty)
+    {
+        order.qty -= qty;
+        _totalQty -= qty;
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn)
+    {
+        for (uint32_t pos = 0; pos < _count; ++pos)
+            fn(*_slots[Slot(pos)]);
+    }
+
+    template <typename Fn>
+    void drain(Fn&& fn)
+    {
+        forEach(fn);
+        _first = 0;
+        _count = 0;
+        _totalQty = 0;
+    }
+
+private:
+    // the slot pos places behind the front. the capacity is always a power of two
+    size_t Slot(uint32_t pos) const { return (_first + pos) & (_slots.size() - 1); }
+
+    void Grow()
+    {
+        std::rotate(_slots.begin(), _slots.begin() + _first, _slots.end());
+        _first = 0;
+        _slots.resize(_slots.size() * 2);
+    }
+
+    bear::small_vector<Order*, RING_LEVEL_INLINE_ORDERS> _slots;
+    uint32_t _first = 0;
+    uint32_t _count = 0;
+    int64_t _totalQty = 0;
+};
+static_assert((RING_LEVEL_INLINE_ORDERS & (RING_LEVEL_INLINE_ORDERS - 1)) == 0);
+
+#ifdef TRADE_RING_LEVELS
+using LevelQueue = RingLevelQueue;
+#else
+using LevelQueue = ListLevelQueue;
+#endif
+
+// the two sides of the book as types. Compare orders a side's levels best first, and AtOrBetter(price,
+// limit) is whether price comes no later than limit in that order: a level within a passive limit, or an
+// aggressor's price crossing the other side's best
+struct SellSide;
+
+struct BuySide
+{
+    static constexpr bool IS_BUY = true;
+    static constexpr int32_t MARKET_LIMIT = INT32_MAX; // a buy limit that reaches every ask
+    using Compare = std::greater<int32_t>;
+    using Opposite = SellSide;
+    static constexpr bool AtOrBetter(int32_t price, int32_t limit) { return price >= limit; }
+};
+
+struct SellSide
+{
+    static constexpr bool IS_BUY = false;
+    static constexpr int32_t MARKET_LIMIT = INT32_MIN;
+    using Compare = std::less<int32_t>;
+    using Opposite = BuySide;
+    static constexpr bool AtOrBetter(int32_t price, int32_t limit) { return price <= limit; }
+};
+
+// ticks per side covered by the flat ladder, anything outside it lives in a std::map. 0 means map only
+constexpr size_t DEFAULT_LADDER_BAND = 4096;
+
+struct MarketConfig
+{
+    size_t ladderBand = DEFAULT_LADDER_BAND;
+    size_t poolChunkBytes = DEFAULT_POOL_CHUNK_BYTES;
+    bool poolPrefault = false; // touch every pool page when it's allocated
+    size_t reserveOrders = 0; // pool and id index room for this many live orders up front
+    bool directIds = true; // let the id index use a direct window while ids are dense
+    bool depthUpdates = false; // OnDepth for every level a command changed, after its other output
+    bool amendInPlace = false; // a same price, qty down revise keeps its queue place, see ReviseOrder
+};
+
+// Sink is EventSink for the usual virtual output, or a final sink such as NullSink, whose calls are bound
+// and inlined at compile time (so NullMarket does no output work at all)
+template <typename Sink>
+struct BasicMarket
+{
+    explicit BasicMarket(Sink& sink, const MarketConfig& config = MarketConfig())
+        : _sink(&sink)
+        , _pool(config.poolChunkBytes, config.poolPrefault)
+        , _idToSideLevel(config.directIds)
+        , _bidLevels(config.ladderBand, BidLevels::allocator_type(&_pool))
+        , _askLevels(config.ladderBand, AskLevels::allocator_type(&_pool))
+        , _depthUpdates(config.depthUpdates)
+        , _amendInPlace(config.amendInPlace)
+    {
+        Reserve(config.reserveOrders);
+    }
+
+    BasicMarket(const BasicMarket&) = delete;
+    BasicMarket& operator=(const BasicMarket&) = delete;
+
+    void Process(const Command& cmd)
+    {
+        ++_counters.commands;
+        switch (cmd.type)
+        {
+        case CommandType::Buy:
+            ++_counters.orders;
+            AddOrder<BuySide>(cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::Sell:
+            ++_counters.orders;
+            AddOrder<SellSide>(cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::Revise:
+            ++_counters.revises;
+            ReviseOrder(cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::Cancel:
+            ++_counters.cancels;
+            CancelOrder(cmd.orderId);
+            break;
+        case CommandType::Depth:
+            PublishBook(cmd.orderId, size_t(std::max(cmd.qty, 0)));
+            break;
+        case CommandType::IocBuy:
+        case CommandType::FokBuy:
+        case CommandType::MarketBuy:
+            ++_counters.immediates;
+            ImmediateOrder<BuySide>(ImmediateKindOf(cmd.type), cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::IocSell:
+        case CommandType::FokSell:
+        case CommandType::MarketSell:
+            ++_counters.immediates;
+            ImmediateOrder<SellSide>(ImmediateKindOf(cmd.type), cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::Stats:
+            PublishStats(cmd.orderId);
+            break;
+        case CommandType::Invalid:
+            Emit([&](auto& out) { out.OnParseError(); });
+            break;
+        default:
+            break;
+        }
+        if (!_changedLevels.empty())
+            PublishDepth();
+    }
+
+    // the same as Process on each command in turn, but PREFETCH_AHEAD commands out it prefetches the id
+    // index slot or price level slot that command will start from. only the slot: following it to the
+    // order would be the very miss this is meant to hide, taken early and in line. with a virtual sink the
+    // batch's output is collected in _batchOutput and handed to the sink at the end, so the matching runs
+    // without the formatting in between.
+    // bench --cancel 60 --add 35 --revise 0 --depth 200000 --band 2000 --hashed-ids, M msg/s:
+    //   NullMarket                    --batch 0: 42-44   --batch 64/256: 45-48
+    //   --virtual-sink                --batch 0: 38-41   --batch 64:     31-33  (the replay's dispatch)
+    //   --text                        --batch 0: 25-27   --batch 64:     23-24
+    //   --journal --journal-sync none --batch 0: 30-33   --batch 64:     27-29  (NullMarket, prefetch or not)
+    // so it pays on the bare matching, and so far not once there's a sink or a journal behind it
+    void ProcessBatch(std::span<const Command> cmds)
+    {
+        _batching = BUFFERS_BATCH_OUTPUT;
+        for (size_t ii = 0; ii < cmds.size(); ++ii)
+        {
+            if (ii + PREFETCH_AHEAD < cmds.size())
+                PrefetchSlot(cmds[ii + PREFETCH_AHEAD]);
+            Process(cmds[ii]);
+        }
+        if constexpr (BUFFERS_BATCH_OUTPUT)
+        {
+            _batching = false;
+            _batchOutput.Replay(*_sink);
+        }
+    }
+
+    // from here on the side is a type, so each of these is instantiated once per side with the isBuy tests
+    // folded away
+
+    template <typename Side>
+    void AddOrder(uint64_t orderId, int32_t qty, int32_t price)
+    {
+        // printf("DEBUG AddOrder: orderId=%lu isBuy=%d qty=%d price=%d\n", orderId, Side::IS_BUY, qty, price);
+        LevelQueue& levelQueue = Levels<Side>()[price]; // construct if not exist
+        Order* order = NewOrder(orderId, price, qty);
+        levelQueue.push_back(order);
+        _idToSideLevel[orderId] = SideLevel(Side::IS_BUY, price, order);
+        LevelChanged(Side::IS_BUY, price);
+        _counters.NoteBookSize(Side::IS_BUY, _idToSideLevel.size(), Levels<Side>().size());
+
+        Emit([&](auto& out) { out.OnOrder(Side::IS_BUY, qty, price, orderId); });
+
+        MatchOrders<Side>();
+    }
+
+    void ReviseOrder(uint64_t orderId, int32_t qty, int32_t price)
+    {
+        // printf("DEBUG ReviseOrder: orderId=%lu qty=%d price=%d\n", orderId, qty, price);
+        if (SideLevel* found = _idToSideLevel.find(orderId))
+        {
+            if (found->isBuy) // cannot change side with revise
+                ReviseOrder<BuySide>(*found, orderId, qty, price);
+            else
+                ReviseOrder<SellSide>(*found, orderId, qty, price);
+        }
+        else
+            ++_counters.unknownRevises;
+    }
+
+    // sideLevel is a copy, the entry is gone if the new order fully fills
+    template <typename Side>
+    void ReviseOrder(SideLevel sideLevel, uint64_t orderId, int32_t qty, int32_t price)
+    {
+        if (_amendInPlace && price == sideLevel.price && 0 < qty && qty < sideLevel.order->qty)
+        {
+            // nothing can cross that didn't before, so no matching, and the order keeps its time priority
+            Levels<Side>().find(price)->reduce(*sideLevel.order, sideLevel.order->qty - qty);
+            LevelChanged(Side::IS_BUY, price);
+            Emit([&](auto& out) { out.OnRevise(qty, price, orderId); });
+            return;
+        }
+        CancelOrder<Side>(sideLevel, orderId);
+        AddOrder<Side>(orderId, qty, price);
+    }
+
+    template <typename Side>
+    void CancelOrder(SideLevel sideLevel, uint64_t orderId)
+    {
+        LevelQueue* levelQueue = Levels<Side>().find(sideLevel.price);
+        if (!levelQueue)
+            return; // should never happen
+        int32_t qtyCancelled = sideLevel.order->qty;
+        levelQueue->erase(sideLevel.order);
+        FreeOrder(sideLevel.order);
+        if (levelQueue->empty()) // an empty level must never be seen as a best by TryMatchBests
+            Levels<Side>().erase(sideLevel.price);
+        LevelChanged(Side::IS_BUY, sideLevel.price);
+        Emit([&](auto& out) { out.OnCancel(orderId, qtyCancelled); });
+    }
+
+    void CancelOrder(uint64_t orderId)
+    {
+        // printf("DEBUG CancelOrder: orderId=%lu\n", orderId);
+        if (SideLevel* found = _idToSideLevel.find(orderId))
+        {
+            if (found->isBuy)
+                CancelOrder<BuySide>(*found, orderId);
+            else
+                CancelOrder<SellSide>(*found, orderId);
+            _idToSideLevel.erase(orderId);
+        }
+        else
+            ++_counters.unknownCancels;
+    }
+
+    // IOC, FOK and MARKET orders never rest, so rather than going through the book and MatchOrders they
+    // sweep the other side directly, then cancel whatever is left
+    template <typename Side>
+    void ImmediateOrder(ImmediateKind kind, uint64_t orderId, int32_t qty, int32_t price)
+    {
+        using Passive = typename Side::Opposite;
+        Emit([&](auto& out) { out.OnImmediate(kind, Side::IS_BUY, qty, price, orderId); });
+        if (kind == ImmediateKind::Market)
+            price = Side::MARKET_LIMIT;
+        int32_t left = qty;
+        if (kind != ImmediateKind::Fok || CanFill<Passive>(qty, price))
+            left = Sweep<Passive>(orderId, qty, price);
+        if (left > 0)
+            Emit([&](auto& out) { out.OnCancel(orderId, left); });
+    }
+
+    // whether the levels at limit or better hold qty, read off their totals so a FOK that can't fill
+    // touches nothing
+    template <typename Passive>
+    bool CanFill(int32_t qty, int32_t limit)
+    {
+        int64_t available = 0;
+        Levels<Passive>().forEachBestWhile([&](int32_t price, LevelQueue& level)
+                                           {
+                                               if (!Passive::AtOrBetter(price, limit))
+                                                   return false;
+                                               available += level.totalQty();
+                                               return available < qty;
+                                           });
+        return available >= qty;
+    }
+
+    // trades qty against levels at limit or better, best first, and returns what's left. a level the
+    // order covers is taken whole, without touching its total per fill, and only the last one is eaten
+    // into from the front
+    template <typename Passive>
+    int32_t Sweep(uint64_t aggrId, int32_t qty, int32_t limit)
+    {
+        int32_t price;
+        while (qty > 0)
+        {
+            LevelQueue* level = Levels<Passive>().best(price);
+            if (!level || !Passive::AtOrBetter(price, limit))
+                break;
+            if (level->totalQty() <= qty)
+            {
+                qty -= int32_t(level->totalQty());
+                _counters.trades += level->orderCount();
+                if constexpr (LATENCY_ENABLED)
+                {
+                    _matchCounters.trades += level->orderCount();
+                    ++_matchCounters.levelsSwept;
+                }
+                level->drain([&](Order& order)
+                             {
+                                 Emit([&](auto& out) { out.OnTrade(aggrId, order.orderId, order.qty, price); });
+                                 _idToSideLevel.erase(order.orderId);
+                                 FreeOrder(&order);
+                             });
+                Levels<Passive>().erase(price);
+            }
+            else
+            {
+                while (qty > 0)
+                {
+                    Order& order = level->front();
+                    uint64_t passiveId = order.orderId;
+                    int32_t tradeQty = std::min(qty, order.qty);
+                    qty -= tradeQty;
+                    FillFront(*level, order, tradeQty);
+                    Emit([&](auto& out) { out.OnTrade(aggrId, passiveId, tradeQty, price); });
+                    ++_counters.trades;
+                    if constexpr (LATENCY_ENABLED)
+                        ++_matchCounters.trades;
+                }
+            }
+            LevelChanged(Passive::IS_BUY, price);
+        }
+        return qty;
+    }
+
+    template <typename Aggressor>
+    void MatchOrders()
+    {
+        // match all orders which can match and print them
+        while (TryMatchBests<Aggressor>())
+            continue;
+    }
+
+    // one fill between the fronts of the best levels, if they cross. the aggressor is always alone at the
+    // front of its best level, it only crosses because its price is better than anything that rested there
+    template <typename Aggressor>
+    bool TryMatchBests()
+    {
+        using Passive = typename Aggressor::Opposite;
+        int32_t aggrPrice;
+        int32_t passivePrice;
+        LevelQueue* aggrQueue = Levels<Aggressor>().best(aggrPrice);
+        if (!aggrQueue)
+            return false;
+        LevelQueue* passiveQueue = Levels<Passive>().best(passivePrice);
+        if (!passiveQueue)
+            return false;
+        if (!Aggressor::AtOrBetter(aggrPrice, passivePrice))
+            return false;
+
+        // else, we can match
+        Order& aggrOrder = aggrQueue->front();
+        Order& passiveOrder = passiveQueue->front();
+        uint64_t aggrId = aggrOrder.orderId;
+        uint64_t passiveId = passiveOrder.orderId;
+        int32_t tradeQty = std::min(aggrOrder.qty, passiveOrder.qty);
+        FillFront(*aggrQueue, aggrOrder, tradeQty);
+        FillFront(*passiveQueue, passiveOrder, tradeQty); // either front may be gone after this, use the saved ids
+        Emit([&](auto& out) { out.OnTrade(aggrId, passiveId, tradeQty, passivePrice); });
+        ++_counters.trades;
+        if constexpr (LATENCY_ENABLED)
+        {
+            ++_matchCounters.trades;
+            if (passiveQueue->empty())
+                ++_matchCounters.levelsSwept;
+        }
+        if (passiveQueue->empty())
+            Levels<Passive>().erase(passivePrice);
+        if (aggrQueue->empty())
+            Levels<Aggressor>().erase(aggrPrice);
+        LevelChanged(true, Aggressor::IS_BUY ? aggrPrice : passivePrice); // bids first, like before
+        LevelChanged(false, Aggressor::IS_BUY ? passivePrice : aggrPrice);
+        return true;
+        // TRADE <AGGRESSIVE ID> <PASSIVE ID> <QTY> <PRICE>
+    }
+
+    // qty off the front order of queue, which is popped and freed if that's all of it
+    void FillFront(LevelQueue& queue, Order& order, int32_t qty)
+    {
+        if (qty < order.qty)
+        {
+            queue.reduce(order, qty);
+            return;
+        }
+        uint64_t orderId = order.orderId;
+        queue.pop_front();
+        FreeOrder(&order);
+        _idToSideLevel.erase(orderId);
+    }
+
+    // BOOK with how many levels follow, then a LEVEL for each of the best levels per side, bids first
+    void PublishBook(uint64_t requestId, size_t levels)
+    {
+        uint32_t bidLevels = uint32_t(std::min(levels, _bidLevels.size()));
+        uint32_t askLevels = uint32_t(std::min(levels, _askLevels.size()));
+        Emit([&](auto& out) { out.OnBook(requestId, bidLevels, askLevels); });
+        _bidLevels.forEachBest(bidLevels, [&](int32_t price, LevelQueue& level)
+                               { Emit([&](auto& out) { out.OnBookLevel(true, price, level.totalQty(), level.orderCount()); }); });
+        _askLevels.forEachBest(askLevels, [&](int32_t price, LevelQueue& level)
+                               { Emit([&](auto& out) { out.OnBookLevel(false, price, level.totalQty(), level.orderCount()); }); });
+    }
+
+    // STATS with how many follow, then a STAT for each of Stats() in StatId order
+    void PublishStats(uint64_t requestId)
+    {
+        MarketStats stats = Stats();
+        Emit([&](auto& out) { out.OnStats(requestId, uint32_t(NUM_STATS)); });
+        for (size_t ii = 0; ii < NUM_STATS; ++ii)
+            Emit([&](auto& out) { out.OnStat(StatId(ii), stats.values[ii]); });
+    }
+
+    // the counters so far and the book's size and memory now. cheap enough for every batch, not every command
+    MarketStats Stats() const
+    {
+        MarketStats stats;
+        stats[StatId::Commands] = _counters.commands;
+        stats[StatId::Orders] = _counters.orders;
+        stats[StatId::Revises] = _counters.revises;
+        stats[StatId::Cancels] = _counters.cancels;
+        stats[StatId::Immediates] = _counters.immediates;
+        stats[StatId::Trades] = _counters.trades;
+        stats[StatId::UnknownCancels] = _counters.unknownCancels;
+        stats[StatId::UnknownRevises] = _counters.unknownRevises;
+        stats[StatId::RestingOrders] = _idToSideLevel.size();
+        stats[StatId::PeakRestingOrders] = _counters.peakRestingOrders;
+        stats[StatId::BidLevels] = _bidLevels.size();
+        stats[StatId::AskLevels] = _askLevels.size();
+        stats[StatId::PeakBidLevels] = _counters.peakBidLevels;
+        stats[StatId::PeakAskLevels] = _counters.peakAskLevels;
+        stats[StatId::PoolAllocs] = _pool.allocCount();
+        stats[StatId::PoolFrees] = _pool.freeCount();
+        stats[StatId::PoolBytesInUse] = _pool.bytesInUse() + _pool.largeBytesInUse();
+        stats[StatId::PoolBytesReserved] = _pool.bytesReserved();
+        stats[StatId::PoolChunks] = _pool.chunkCount();
+        stats[StatId::IndexBytes] = _idToSideLevel.bytes();
+        stats[StatId::LadderBytes] = _bidLevels.bandBytes() + _askLevels.bandBytes();
+        stats[StatId::MemoryBytes] = _pool.bytesReserved() + _pool.largeBytesInUse() + stats[StatId::IndexBytes]
+                                     + stats[StatId::LadderBytes];
+        return stats;
+    }
+
+    void LevelChanged(bool isBuy, int32_t price)
+    {
+        if (!_depthUpdates)
+            return;
+        for (const ChangedLevel& changed : _changedLevels) // a command rarely touches more than a few levels
+        {
+            if (changed.isBuy == isBuy && changed.price == price)
+                return;
+        }
+        _changedLevels.push_back(ChangedLevel{isBuy, price});
+    }
+
+    // where each changed level ended up, in the order they first changed. 0 qty and 0 orders if it's gone
+    void PublishDepth()
+    {
+        for (const ChangedLevel& changed : _changedLevels)
+        {
+            LevelQueue* level = changed.isBuy ? _bidLevels.find(changed.price) : _askLevels.find(changed.price);
+            if (level)
+                Emit([&](auto& out) { out.OnDepth(changed.isBuy, changed.price, level->totalQty(), level->orderCount()); });
+            else
+                Emit([&](auto& out) { out.OnDepth(changed.isBuy, changed.price, 0, 0); });
+        }
+        _changedLevels.clear();
+    }
+
+    // e.g. a NullSink while replaying commands whose output already went out
+    void SetSink(Sink& sink) { _sink = &sink; }
+
+    // room for count live orders in the pool and the id index
+    void Reserve(size_t count)
+    {
+        _pool.reserve(sizeof(Order), count);
+        _idToSideLevel.reserve(count);
+    }
+
+    // fn(isBuy, order, indexed) for every resting order, level by level and in queue order within each.
+    // indexed is whether its id finds it, which it doesn't if a later order reused the id
+    template <typename Fn>
+    void ForEachOrder(Fn&& fn)
+    {
+        auto visit = [&](bool isBuy, LevelQueue& level)
+        {
+            level.forEach([&](Order& order)
+                          {
+                              SideLevel* found = _idToSideLevel.find(order.orderId);
+                              fn(isBuy, order, found && found->order == &order);
+                          });
+        };
+        _bidLevels.forEach([&](int32_t, LevelQueue& level) { visit(true, level); });
+        _askLevels.forEach([&](int32_t, LevelQueue& level) { visit(false, level); });
+    }
+
+    // puts an order at the back of its level as it is, without any output or matching, for rebuilding a
+    // book from a snapshot
+    void RestoreOrder(uint64_t orderId, bool isBuy, int32_t qty, int32_t price, bool indexed)
+    {
+        LevelQueue* levelQueue;
+        if (isBuy)
+            levelQueue = &_bidLevels[price];
+        else
+            levelQueue = &_askLevels[price];
+        Order* order = NewOrder(orderId, price, qty);
+        levelQueue->push_back(order);
+        if (indexed)
+            _idToSideLevel[orderId] = SideLevel(isBuy, price, order);
+        _counters.NoteBookSize(isBuy, _idToSideLevel.size(), isBuy ? _bidLevels.size() : _askLevels.size());
+    }
+
+    // what matching did since the last call, only counted with TRADE_LATENCY
+    MatchCounters TakeMatchCounters()
+    {
+        MatchCounters counters = _matchCounters;
+        _matchCounters = MatchCounters();
+        return counters;
+    }
+
+    static constexpr size_t PREFETCH_AHEAD = 8; // commands, roughly a memory latency's worth of them
+    // a final sink's calls are already free, nothing to gain by putting them off
+    static constexpr bool BUFFERS_BATCH_OUTPUT = std::is_same_v<Sink, EventSink>;
+
+    // out(sink) with whichever sink the event goes to. in a batch it's the final EventBuffer, whose calls
+    // are direct and inlined
+    template <typename Out>
+    void Emit(Out&& out)
+    {
+        if (BUFFERS_BATCH_OUTPUT && _batching)
+            out(_batchOutput);
+        else
+            out(*_sink);
+    }
+
+    void PrefetchSlot(const Command& cmd)
+    {
+        switch (cmd.type)
+        {
+        case CommandType::Buy:
+            _bidLevels.prefetch(cmd.price);
+            break;
+        case CommandType::Sell:
+            _askLevels.prefetch(cmd.price);
+            break;
+        case CommandType::Revise:
+        case CommandType::Cancel:
+            _idToSideLevel.prefetch(cmd.orderId);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Order* NewOrder(uint64_t orderId, int32_t price, int32_t qty)
+    {
+        return new (_pool.allocate(sizeof(Order), alignof(Order))) Order(orderId, price, qty);
+    }
+
+    void FreeOrder(Order* order) { _pool.deallocate(order, sizeof(Order), alignof(Order)); } // Order is trivially destructible
+
+    template <typename Side>
+    using SideLevels = PriceLadder<LevelQueue, typename Side::Compare, PoolAllocator<std::pair<const int32_t, LevelQueue>>>;
+    using BidLevels = SideLevels<BuySide>;
+    using AskLevels = SideLevels<SellSide>;
+
+    template <typename Side>
+    SideLevels<Side>& Levels()
+    {
+        if constexpr (Side::IS_BUY)
+            return _bidLevels;
+        else
+            return _askLevels;
+    }
+
+    Sink* _sink;
+    EventBuffer _batchOutput; // ProcessBatch's events, only while it runs
+    bool _batching = false;
+
+    // orders and container nodes all come from here, so it's declared first and destroyed last.
+    // live orders are released along with the pool
+    SlabPool _pool;
+
+    OrderIdIndex<SideLevel> _idToSideLevel;
+
+    // bid levels are in descending order, best is highest
+    BidLevels _bidLevels;
+    // ask levels are in ascending order, best is lowest
+    AskLevels _askLevels;
+
+    struct ChangedLevel
+    {
+        bool isBuy;
+        int32_t price;
+    };
+    bool _depthUpdates;
+    bool _amendInPlace;
+    std::vector<ChangedLevel> _changedLevels; // by the command being processed, only with _depthUpdates
+
+    MarketCounters _counters;
+    MatchCounters _matchCounters;
+};
+
+using Market = BasicMarket<EventSink>;
+using NullMarket = BasicMarket<NullSink>; // for benchmarking the matching without any output
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "command.h"
+#include "market.h"
+#include "protocol.h"
+#include "reader.h"
+#include "sink.h"
+#include "spsc.h"
+
+// pipelined single-book mode: parsing, matching and output formatting each get their own thread, handing
+// work on through SpscRings. the calling thread parses and pushes Commands, the matcher runs them through
+// the Market, whose events go out as BinaryEvent records to the publisher, which replays them into the
+// real output sink. every stage sees everything in input order, so the output is the same as without it.
+
+constexpr size_t PIPELINE_RING_RECORDS = 64 * 1024;
+
+struct PipelineConfig
+{
+    size_t ringCapacity = PIPELINE_RING_RECORDS; // per ring
+    BackOff backOff = BackOff::Block;
+    int parseCpu = -1; // < 0 leaves the stage unpinned
+    int matchCpu = -1;
+    int publishCpu = -1;
+};
+
+// the matcher's sink, encodes events onto the ring for the publisher
+class RingSink : public EventSink
+{
+public:
+    explicit RingSink(SpscRing<BinaryEvent>& ring)
+        : _ring(ring)
+    {
+    }
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        _ring.push(MakeEvent(isBuy ? BinaryEventType::Buy : BinaryEventType::Sell, orderId, 0, qty, price));
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        _ring.push(MakeEvent(BinaryEventType::Revise, orderId, 0, qty, price));
+    }
+
+    void OnCancel(uint64_t orderId, int32_t qty) override { _ring.push(MakeEvent(BinaryEventType::Cancel, orderId, 0, qty, 0)); }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        _ring.push(MakeEvent(BinaryEventType::Trade, aggressorId, passiveId, qty, price));
+    }
+
+    void OnParseError() override { _ring.push(MakeEvent(BinaryEventType::ParseError, 0, 0, 0, 0)); }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        _ring.push(MakeEvent(ImmediateEventType(kind, isBuy), orderId, 0, qty, price));
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        _ring.push(MakeEvent(isBuy ? BinaryEventType::DepthBid : BinaryEventType::DepthAsk, uint64_t(qty), orders, 0, price));
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        _ring.push(MakeEvent(BinaryEventType::Book, requestId, bidLevels, int32_t(askLevels), 0));
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        _ring.push(MakeEvent(isBuy ? BinaryEventType::BookBid : BinaryEventType::BookAsk, uint64_t(qty), orders, 0, price));
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override
+    {
+        _ring.push(MakeEvent(BinaryEventType::Stats, requestId, 0, int32_t(count), 0));
+    }
+
+    void OnStat(StatId stat, uint64_t value) override { _ring.push(MakeEvent(BinaryEventType::Stat, value, uint64_t(stat), 0, 0)); }
+
+private:
+    SpscRing<BinaryEvent>& _ring;
+};
+
+class Pipeline
+{
+public:
+    Pipeline(EventSink& out, const MarketConfig& marketConfig, const PipelineConfig& config)
+        : _config(config)
+        , _out(out)
+        , _commands(config.ringCapacity, config.backOff)
+        , _events(config.ringCapacity, config.backOff)
+        , _ringSink(_events)
+        , _market(_ringSink, marketConfig)
+    {
+    }
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // runs the whole input through and returns once the output has been flushed.
+    // false if binaryIn and the input isn't a binary command file
+    bool Run(InputReader& reader, bool binaryIn)
+    {
+        std::thread matcher([this] { Match(); });
+        std::thread publisher([this] { Publish(); });
+        PinThisThread(_config.parseCpu);
+
+        auto push = [this](const Command& cmd)
+        {
+            Command routed = cmd;
+            routed.symbol = std::string_view(); // points into input the reader may have moved past
+            _commands.push(routed);
+        };
+        auto batchEnd = [] {}; // the publisher flushes whenever it runs dry instead
+        bool ok = true;
+        if (binaryIn)
+            ok = ReadBinary(reader, push, batchEnd);
+        else
+            ReadText(reader, push, batchEnd);
+
+        Command stop;
+        stop.type = CommandType::Stop;
+        _commands.push(stop);
+        matcher.join();
+        publisher.join();
+        return ok;
+    }
+
+private:
+    static constexpr uint8_t END_OF_EVENTS = 0; // not a BinaryEventType
+
+    void Match()
+    {
+        PinThisThread(_config.matchCpu);
+        Command cmd;
+        for (_commands.pop(cmd); cmd.type != CommandType::Stop; _commands.pop(cmd))
+            _market.Process(cmd);
+        BinaryEvent end = {};
+        end.type = END_OF_EVENTS;
+        _events.push(end);
+    }
+
+    void Publish()
+    {
+        PinThisThread(_config.publishCpu);
+        BinaryEvent record;
+        while (true)
+        {
+            if (!_events.tryPop(record))
+            {
+                _out.Flush(); // nothing queued, so whoever is reading gets what there is so far
+                _events.pop(record);
+            }
+            if (record.type == END_OF_EVENTS)
+                break;
+            DispatchEvent(record, _out);
+        }
+        _out.Flush();
+    }
+
+    PipelineConfig _config;
+    EventSink& _out; // only touched by the publisher
+    SpscRing<Command> _commands;
+    SpscRing<BinaryEvent> _events;
+    RingSink _ringSink;
+    Market _market; // only touched by the matcher
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+// recycling slab allocator, grown from test1.cpp's MemoryPool bump allocator.
+// requests are rounded up to a size class (multiples of 16 bytes up to MAX_SLAB_BLOCK), and each class
+// carves blocks out of its own chunks with a bump pointer. freed blocks go onto the class's intrusive
+// free list and are handed out again first, so once the book has reached its working size, order entry,
+// fills and cancels never call into malloc. chunks are only returned when the pool is destroyed.
+// not thread safe, give each thread (or each Market) its own pool.
+
+constexpr size_t SLAB_GRANULE = 16; // also the strongest alignment slab blocks guarantee
+constexpr size_t MAX_SLAB_BLOCK = 512; // bigger requests go straight to ::operator new
+constexpr size_t DEFAULT_POOL_CHUNK_BYTES = 64 * 1024;
+constexpr size_t PAGE_BYTES = 4096;
+
+class SlabPool
+{
+public:
+    explicit SlabPool(size_t chunkBytes = DEFAULT_POOL_CHUNK_BYTES, bool prefault = false)
+        : _chunkBytes(chunkBytes)
+        , _prefault(prefault)
+    {
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    ~SlabPool() noexcept
+    {
+        while (_chunks)
+        {
+            ChunkHeader* next = _chunks->next;
+            ::operator delete(_chunks, std::align_val_t(CHUNK_ALIGN));
+            _chunks = next;
+        }
+    }
+
+    void* allocate(size_t size, size_t alignment)
+    {
+        ++_allocCount;
+        if (size > MAX_SLAB_BLOCK || alignment > SLAB_GRANULE)
+        {
+            ++_largeAllocs;
+            _largeBytesInUse += size;
+            return ::operator new(size, std::align_val_t(alignment));
+        }
+        SizeClass& cls = _classes[ClassOf(size)];
+        size_t blockSize = BlockSize(ClassOf(size));
+        _bytesInUse += blockSize;
+        if (cls.freeList)
+        {
+            FreeBlock* block = cls.freeList;
+            cls.freeList = block->next;
+            return block;
+        }
+        if (cls.bump + blockSize > cls.bumpEnd)
+            Grow(cls, blockSize, 1);
+        void* ptr = cls.bump;
+        cls.bump += blockSize;
+        return ptr;
+    }
+
+    void deallocate(void* ptr, size_t size, size_t alignment) noexcept
+    {
+        if (!ptr)
+            return;
+        ++_freeCount;
+        if (size > MAX_SLAB_BLOCK || alignment > SLAB_GRANULE)
+        {
+            _largeBytesInUse -= size;
+            ::operator delete(ptr, std::align_val_t(alignment));
+            return;
+        }
+        _bytesInUse -= BlockSize(ClassOf(size));
+        PushFree(_classes[ClassOf(size)], ptr);
+    }
+
+    // make sure count blocks of this size can be handed out without growing, e.g. for the expected number
+    // of live orders, so that not even the first fills of the day allocate
+    void reserve(size_t size, size_t count)
+    {
+        if (size > MAX_SLAB_BLOCK)
+            return;
+        size_t blockSize = BlockSize(ClassOf(size));
+        SizeClass& cls = _classes[ClassOf(size)];
+        size_t available = size_t(cls.bumpEnd - cls.bump) / blockSize;
+        for (FreeBlock* block = cls.freeList; block && available < count; block = block->next)
+            ++available;
+        if (available < count)
+            Grow(cls, blockSize, count - available);
+    }
+
+    size_t chunkCount() const { return _chunkCount; }
+    size_t bytesReserved() const { return _bytesReserved; }
+    size_t largeAllocs() const { return _largeAllocs; }
+    // allocate and deallocate calls, big blocks included, and what's out right now: slab blocks at their
+    // size class, big blocks as asked for
+    uint64_t allocCount() const { return _allocCount; }
+    uint64_t freeCount() const { return _freeCount; }
+    size_t bytesInUse() const { return _bytesInUse; }
+    size_t largeBytesInUse() const { return _largeBytesInUse; }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct ChunkHeader
+    {
+        ChunkHeader* next;
+    };
+
+    struct SizeClass
+    {
+        FreeBlock* freeList = nullptr;
+        std::byte* bump = nullptr; // uncarved part of the newest chunk
+        std::byte* bumpEnd = nullptr;
+    };
+
+    static constexpr size_t NUM_CLASSES = MAX_SLAB_BLOCK / SLAB_GRANULE;
+    static constexpr size_t CHUNK_ALIGN = 64;
+    static constexpr size_t CHUNK_HEADER_BYTES = CHUNK_ALIGN; // keeps the first block cache line aligned
+
+    static size_t ClassOf(size_t size) { return size == 0 ? 0 : (size - 1) / SLAB_GRANULE; }
+    static size_t BlockSize(size_t cls) { return (cls + 1) * SLAB_GRANULE; }
+
+    static void PushFree(SizeClass& cls, void* ptr)
+    {
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = cls.freeList;
+        cls.freeList = block;
+    }
+
+    // new chunk with room for at least minBlocks. whatever is left of the previous chunk goes onto
+    // the free list so it isn't lost
+    void Grow(SizeClass& cls, size_t blockSize, size_t minBlocks)
+    {
+        for (; cls.bump + blockSize <= cls.bumpEnd; cls.bump += blockSize)
+            PushFree(cls, cls.bump);
+
+        size_t bytes = CHUNK_HEADER_BYTES + std::max(_chunkBytes, minBlocks * blockSize);
+        std::byte* chunk = static_cast<std::byte*>(::operator new(bytes, std::align_val_t(CHUNK_ALIGN)));
+        if (_prefault) // take the page faults now rather than on the matching path
+        {
+            for (size_t off = 0; off < bytes; off += PAGE_BYTES)
+                chunk[off] = std::byte(0);
+        }
+        ChunkHeader* header = reinterpret_cast<ChunkHeader*>(chunk);
+        header->next = _chunks;
+        _chunks = header;
+        ++_chunkCount;
+        _bytesReserved += bytes;
+
+        cls.bump = chunk + CHUNK_HEADER_BYTES;
+        cls.bumpEnd = chunk + bytes;
+    }
+
+    SizeClass _classes[NUM_CLASSES];
+    ChunkHeader* _chunks = nullptr;
+    size_t _chunkBytes;
+    bool _prefault;
+    size_t _chunkCount = 0;
+    size_t _bytesReserved = 0;
+    size_t _largeAllocs = 0;
+    uint64_t _allocCount = 0;
+    uint64_t _freeCount = 0;
+    size_t _bytesInUse = 0;
+    size_t _largeBytesInUse = 0;
+};
+
+// process wide pool for allocators which aren't given one, like test1.cpp's GetSharedPool()
+inline SlabPool& GetDefaultPool()
+{
+    static SlabPool pool;
+    return pool;
+}
+
+// stateful allocator over a SlabPool, usable by the std containers and bear::vector
+template <typename T>
+struct PoolAllocator
+{
+    using value_type = T;
+
+    PoolAllocator() noexcept : pool(&GetDefaultPool()) {}
+    explicit PoolAllocator(SlabPool* p) noexcept : pool(p) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& alloc) noexcept : pool(alloc.pool) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, size_t n) noexcept { pool->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    SlabPool* pool;
+};
+
+// memory from one pool can only be given back to the same pool
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) { return lhs.pool == rhs.pool; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) { return lhs.pool != rhs.pool; }
+
+// a SlabPool behind std::pmr::memory_resource, for the pmr containers and anything else taking a
+// std::pmr::polymorphic_allocator (bear::vector included). polymorphic_allocator never propagates, so
+// a container stays on the resource it was made with, whatever gets assigned or swapped into it
+class SlabResource : public std::pmr::memory_resource
+{
+public:
+    explicit SlabResource(size_t chunkBytes = DEFAULT_POOL_CHUNK_BYTES, bool prefault = false)
+        : _pool(chunkBytes, prefault)
+    {
+    }
+
+    SlabPool& pool() { return _pool; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override { return _pool.allocate(bytes, alignment); }
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override { _pool.deallocate(ptr, bytes, alignment); }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    SlabPool _pool;
+};
+
+// the calling thread's own SlabResource, made on first use and freed when the thread exits, so threads
+// allocating from theirs never contend (or lock). memory from it has to be given back on the same thread
+// and mustn't outlive it
+inline SlabResource& ThreadSlabResource()
+{
+    thread_local SlabResource resource;
+    return resource;
+}
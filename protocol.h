@@ -0,0 +1,443 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "command.h"
+#include "reader.h"
+#include "sink.h"
+
+// fixed-width binary encoding of the text protocol at the top of main.cpp.
+// a file is one BinaryFileHeader followed by records which are all the same size, either BinaryCommand
+// (input) or BinaryEvent (output). all fields are little-endian, and records are laid out so that every
+// field is naturally aligned as long as the file is mapped at an 8 byte boundary.
+
+static_assert(std::endian::native == std::endian::little, "records are read and written as they are in memory");
+
+constexpr char BINARY_MAGIC[4] = {'W', 'J', 'B', 'N'};
+constexpr uint16_t BINARY_VERSION = 1;
+
+enum class BinaryKind : uint16_t
+{
+    Commands = 1,
+    Events = 2,
+};
+
+struct BinaryFileHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t kind; // BinaryKind
+    uint32_t recordSize; // lets a reader reject a file written with a different layout
+    uint32_t reserved;
+};
+static_assert(sizeof(BinaryFileHeader) == 16);
+
+enum class BinaryCommandType : uint8_t
+{
+    Buy = 1,
+    Sell = 2,
+    Revise = 3,
+    Cancel = 4,
+    Invalid = 5, // unknown command word in the text it was converted from
+    Depth = 6, // orderId is the request id, qty the number of levels
+    IocBuy = 7, // through MarketSell, in CommandType's order. price is 0 for MARKET
+    IocSell = 8,
+    FokBuy = 9,
+    FokSell = 10,
+    MarketBuy = 11,
+    MarketSell = 12,
+    Stats = 13, // orderId is the request id
+};
+
+struct BinaryCommand
+{
+    uint64_t orderId;
+    int32_t qty; // 0 for CANCEL
+    int32_t price; // 0 for CANCEL
+    uint8_t type; // BinaryCommandType
+    uint8_t pad[7];
+};
+static_assert(sizeof(BinaryCommand) == 24);
+
+enum class BinaryEventType : uint8_t
+{
+    Buy = 1,
+    Sell = 2,
+    Revise = 3,
+    Cancel = 4,
+    Trade = 5,
+    ParseError = 6,
+    DepthBid = 7,
+    DepthAsk = 8,
+    Book = 9,
+    BookBid = 10, // LEVEL lines
+    BookAsk = 11,
+    IocBuy = 12, // through MarketSell, the IOC, FOK and MARKET lines in CommandType's order
+    IocSell = 13,
+    FokBuy = 14,
+    FokSell = 15,
+    MarketBuy = 16,
+    MarketSell = 17,
+    Stats = 18,
+    Stat = 19,
+};
+
+inline BinaryEventType ImmediateEventType(ImmediateKind kind, bool isBuy)
+{
+    return BinaryEventType(uint8_t(BinaryEventType::IocBuy) + uint8_t(kind) * 2 + (isBuy ? 0 : 1));
+}
+
+// DEPTH and LEVEL records keep the level's total qty in orderId and its order count in passiveId.
+// BOOK keeps the request id in orderId, the bid level count in passiveId and the ask level count in qty.
+// STATS keeps the request id in orderId and the number of STATs in qty, and STAT its value in orderId and
+// its StatId in passiveId
+struct BinaryEvent
+{
+    uint64_t orderId; // aggressor for TRADE
+    uint64_t passiveId; // TRADE only
+    int32_t qty;
+    int32_t price; // 0 for CANCEL
+    uint8_t type; // BinaryEventType
+    uint8_t pad[7];
+};
+static_assert(sizeof(BinaryEvent) == 32);
+
+template <typename Record>
+BinaryFileHeader MakeBinaryHeader(BinaryKind kind)
+{
+    BinaryFileHeader header = {};
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.kind = uint16_t(kind);
+    header.recordSize = sizeof(Record);
+    return header;
+}
+
+template <typename Record>
+bool CheckBinaryHeader(const BinaryFileHeader& header, BinaryKind kind)
+{
+    return std::memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic)) == 0 && header.version == BINARY_VERSION
+           && header.kind == uint16_t(kind) && header.recordSize == sizeof(Record);
+}
+
+inline BinaryCommand EncodeCommand(const Command& cmd)
+{
+    BinaryCommand record = {};
+    record.orderId = cmd.orderId;
+    switch (cmd.type)
+    {
+    case CommandType::Buy:
+        record.type = uint8_t(BinaryCommandType::Buy);
+        break;
+    case CommandType::Sell:
+        record.type = uint8_t(BinaryCommandType::Sell);
+        break;
+    case CommandType::Revise:
+        record.type = uint8_t(BinaryCommandType::Revise);
+        break;
+    case CommandType::Cancel:
+        record.type = uint8_t(BinaryCommandType::Cancel);
+        return record;
+    case CommandType::Depth:
+        record.type = uint8_t(BinaryCommandType::Depth);
+        break;
+    case CommandType::IocBuy:
+    case CommandType::IocSell:
+    case CommandType::FokBuy:
+    case CommandType::FokSell:
+    case CommandType::MarketBuy:
+    case CommandType::MarketSell:
+        record.type = uint8_t(uint8_t(BinaryCommandType::IocBuy) + uint8_t(cmd.type) - uint8_t(CommandType::IocBuy));
+        break;
+    case CommandType::Stats:
+        record.type = uint8_t(BinaryCommandType::Stats);
+        return record;
+    default:
+        record.type = uint8_t(BinaryCommandType::Invalid);
+        return record;
+    }
+    record.qty = cmd.qty;
+    record.price = cmd.price;
+    return record;
+}
+
+inline Command DecodeCommand(const BinaryCommand& record)
+{
+    Command cmd;
+    cmd.orderId = record.orderId;
+    cmd.qty = record.qty;
+    cmd.price = record.price;
+    switch (BinaryCommandType(record.type))
+    {
+    case BinaryCommandType::Buy:
+        cmd.type = CommandType::Buy;
+        break;
+    case BinaryCommandType::Sell:
+        cmd.type = CommandType::Sell;
+        break;
+    case BinaryCommandType::Revise:
+        cmd.type = CommandType::Revise;
+        break;
+    case BinaryCommandType::Cancel:
+        cmd.type = CommandType::Cancel;
+        break;
+    case BinaryCommandType::Depth:
+        cmd.type = CommandType::Depth;
+        break;
+    case BinaryCommandType::IocBuy:
+    case BinaryCommandType::IocSell:
+    case BinaryCommandType::FokBuy:
+    case BinaryCommandType::FokSell:
+    case BinaryCommandType::MarketBuy:
+    case BinaryCommandType::MarketSell:
+        cmd.type = CommandType(uint8_t(CommandType::IocBuy) + record.type - uint8_t(BinaryCommandType::IocBuy));
+        break;
+    case BinaryCommandType::Stats:
+        cmd.type = CommandType::Stats;
+        break;
+    default:
+        cmd.type = CommandType::Invalid;
+        break;
+    }
+    return cmd;
+}
+
+inline BinaryEvent MakeEvent(BinaryEventType type, uint64_t orderId, uint64_t passiveId, int32_t qty, int32_t price)
+{
+    BinaryEvent record = {};
+    record.orderId = orderId;
+    record.passiveId = passiveId;
+    record.qty = qty;
+    record.price = price;
+    record.type = uint8_t(type);
+    return record;
+}
+
+// replays a BinaryEvent into any sink, e.g. a BufferedSink to turn it back into text
+inline void DispatchEvent(const BinaryEvent& record, EventSink& sink)
+{
+    switch (BinaryEventType(record.type))
+    {
+    case BinaryEventType::Buy:
+        sink.OnOrder(true, record.qty, record.price, record.orderId);
+        break;
+    case BinaryEventType::Sell:
+        sink.OnOrder(false, record.qty, record.price, record.orderId);
+        break;
+    case BinaryEventType::Revise:
+        sink.OnRevise(record.qty, record.price, record.orderId);
+        break;
+    case BinaryEventType::Cancel:
+        sink.OnCancel(record.orderId, record.qty);
+        break;
+    case BinaryEventType::Trade:
+        sink.OnTrade(record.orderId, record.passiveId, record.qty, record.price);
+        break;
+    case BinaryEventType::DepthBid:
+    case BinaryEventType::DepthAsk:
+        sink.OnDepth(record.type == uint8_t(BinaryEventType::DepthBid), record.price, int64_t(record.orderId),
+                     uint32_t(record.passiveId));
+        break;
+    case BinaryEventType::Book:
+        sink.OnBook(record.orderId, uint32_t(record.passiveId), uint32_t(record.qty));
+        break;
+    case BinaryEventType::BookBid:
+    case BinaryEventType::BookAsk:
+        sink.OnBookLevel(record.type == uint8_t(BinaryEventType::BookBid), record.price, int64_t(record.orderId),
+                         uint32_t(record.passiveId));
+        break;
+    case BinaryEventType::IocBuy:
+    case BinaryEventType::IocSell:
+    case BinaryEventType::FokBuy:
+    case BinaryEventType::FokSell:
+    case BinaryEventType::MarketBuy:
+    case BinaryEventType::MarketSell:
+    {
+        uint8_t offset = uint8_t(record.type - uint8_t(BinaryEventType::IocBuy));
+        sink.OnImmediate(ImmediateKind(offset / 2), offset % 2 == 0, record.qty, record.price, record.orderId);
+        break;
+    }
+    case BinaryEventType::Stats:
+        sink.OnStats(record.orderId, uint32_t(record.qty));
+        break;
+    case BinaryEventType::Stat:
+        if (record.passiveId < NUM_STATS)
+            sink.OnStat(StatId(record.passiveId), record.orderId);
+        else
+            sink.OnParseError();
+        break;
+    default:
+        sink.OnParseError();
+        break;
+    }
+}
+
+// BinaryEvent records into a reusable buffer, written like BufferedSink. the header goes out with the
+// first flush, so an empty run still produces a valid file
+class BinarySink : public EventSink
+{
+public:
+    explicit BinarySink(int fd, size_t capacity = OUTPUT_BUFFER_BYTES)
+        : _fd(fd)
+    {
+        _records.reserve(std::max<size_t>(capacity / sizeof(BinaryEvent), 1));
+    }
+
+    BinarySink(const BinarySink&) = delete;
+    BinarySink& operator=(const BinarySink&) = delete;
+
+    ~BinarySink() override { Flush(); }
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        Put(isBuy ? BinaryEventType::Buy : BinaryEventType::Sell, orderId, 0, qty, price);
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        Put(BinaryEventType::Revise, orderId, 0, qty, price);
+    }
+
+    void OnCancel(uint64_t orderId, int32_t qty) override { Put(BinaryEventType::Cancel, orderId, 0, qty, 0); }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        Put(BinaryEventType::Trade, aggressorId, passiveId, qty, price);
+    }
+
+    void OnParseError() override { Put(BinaryEventType::ParseError, 0, 0, 0, 0); }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        Put(ImmediateEventType(kind, isBuy), orderId, 0, qty, price);
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        Put(isBuy ? BinaryEventType::DepthBid : BinaryEventType::DepthAsk, uint64_t(qty), orders, 0, price);
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        Put(BinaryEventType::Book, requestId, bidLevels, int32_t(askLevels), 0);
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        Put(isBuy ? BinaryEventType::BookBid : BinaryEventType::BookAsk, uint64_t(qty), orders, 0, price);
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override { Put(BinaryEventType::Stats, requestId, 0, int32_t(count), 0); }
+    void OnStat(StatId stat, uint64_t value) override { Put(BinaryEventType::Stat, value, uint64_t(stat), 0, 0); }
+
+    void Flush() override
+    {
+        if (!_wroteHeader)
+        {
+            BinaryFileHeader header = MakeBinaryHeader<BinaryEvent>(BinaryKind::Events);
+            WriteAll(_fd, reinterpret_cast<const char*>(&header), sizeof(header));
+            _wroteHeader = true;
+        }
+        WriteAll(_fd, reinterpret_cast<const char*>(_records.data()), _records.size() * sizeof(BinaryEvent));
+        _records.clear();
+    }
+
+private:
+    void Put(BinaryEventType type, uint64_t orderId, uint64_t passiveId, int32_t qty, int32_t price)
+    {
+        if (_records.size() == _records.capacity())
+            Flush();
+        _records.push_back(MakeEvent(type, orderId, passiveId, qty, price));
+    }
+
+    int _fd;
+    std::vector<BinaryEvent> _records;
+    bool _wroteHeader = false;
+};
+
+// every event kept as its BinaryEvent record, in order, for handing on later (Replay) or comparing (memcmp)
+class EventBuffer final : public EventSink
+{
+public:
+    std::vector<BinaryEvent> events;
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        Put(isBuy ? BinaryEventType::Buy : BinaryEventType::Sell, orderId, 0, qty, price);
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override { Put(BinaryEventType::Revise, orderId, 0, qty, price); }
+    void OnCancel(uint64_t orderId, int32_t qty) override { Put(BinaryEventType::Cancel, orderId, 0, qty, 0); }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        Put(BinaryEventType::Trade, aggressorId, passiveId, qty, price);
+    }
+
+    void OnParseError() override { Put(BinaryEventType::ParseError, 0, 0, 0, 0); }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        Put(ImmediateEventType(kind, isBuy), orderId, 0, qty, price);
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        Put(isBuy ? BinaryEventType::DepthBid : BinaryEventType::DepthAsk, uint64_t(qty), orders, 0, price);
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        Put(BinaryEventType::Book, requestId, bidLevels, int32_t(askLevels), 0);
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        Put(isBuy ? BinaryEventType::BookBid : BinaryEventType::BookAsk, uint64_t(qty), orders, 0, price);
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override { Put(BinaryEventType::Stats, requestId, 0, int32_t(count), 0); }
+    void OnStat(StatId stat, uint64_t value) override { Put(BinaryEventType::Stat, value, uint64_t(stat), 0, 0); }
+
+    // everything kept so far into sink, and empties the buffer (keeping its capacity)
+    void Replay(EventSink& sink)
+    {
+        for (const BinaryEvent& record : events)
+            DispatchEvent(record, sink);
+        events.clear();
+    }
+
+private:
+    void Put(BinaryEventType type, uint64_t orderId, uint64_t passiveId, int32_t qty, int32_t price)
+    {
+        events.push_back(MakeEvent(type, orderId, passiveId, qty, price));
+    }
+};
+
+// calls onCommand for every record of a binary command file and onBatchEnd after each run of them.
+// resumeAt skips ahead to that input offset after the header. false if the input isn't a command file
+template <typename OnCommand, typename OnBatchEnd>
+bool ReadBinary(InputReader& reader, OnCommand&& onCommand, OnBatchEnd&& onBatchEnd, uint64_t resumeAt = 0)
+{
+    BinaryFileHeader header;
+    if (!reader.take(&header, sizeof(header)) || !CheckBinaryHeader<BinaryCommand>(header, BinaryKind::Commands))
+        return false;
+    if (resumeAt > reader.position())
+        reader.skip(resumeAt - reader.position());
+    const char* begin;
+    const char* end;
+    while (reader.nextRecords(begin, end, sizeof(BinaryCommand)))
+    {
+        for (const char* p = begin; p + sizeof(BinaryCommand) <= end; p += sizeof(BinaryCommand))
+        {
+            BinaryCommand record;
+            std::memcpy(&record, p, sizeof(record));
+            onCommand(DecodeCommand(record));
+        }
+        onBatchEnd();
+    }
+    return true;
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "command.h"
+
+// zero-copy input: regular files (named, or redirected to stdin) are memory-mapped and parsed in place,
+// pipes and terminals are read() in big blocks. either way the parser below never allocates per line,
+// and runs are handed out about a block at a time.
+
+constexpr size_t READ_BLOCK_BYTES = 1024 * 1024;
+
+class InputReader
+{
+public:
+    explicit InputReader(int fd)
+        : _fd(fd)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void* map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                madvise(map, size_t(st.st_size), MADV_SEQUENTIAL);
+                _map = static_cast<const char*>(map);
+                _mapSize = size_t(st.st_size);
+            }
+        }
+        if (!_map)
+            _buffer.resize(READ_BLOCK_BYTES);
+    }
+
+    InputReader(const InputReader&) = delete;
+    InputReader& operator=(const InputReader&) = delete;
+
+    ~InputReader() noexcept
+    {
+        if (_map)
+            munmap(const_cast<char*>(_map), _mapSize);
+    }
+
+    // next run of whole lines (only the last line of the input may lack its newline).
+    // false once the input is exhausted. the previous run is invalidated
+    bool next(const char*& begin, const char*& end)
+    {
+        return NextRun(begin, end, [](const char*, const char* newBegin, const char* newEnd) -> const char*
+                       {
+                           const void* lastNewline = memrchr(newBegin, '\n', size_t(newEnd - newBegin));
+                           return lastNewline ? static_cast<const char*>(lastNewline) + 1 : nullptr;
+                       });
+    }
+
+    // same for fixed-size binary records. a truncated record can only be at the very end of the input
+    bool nextRecords(const char*& begin, const char*& end, size_t recordSize)
+    {
+        return NextRun(begin, end, [recordSize](const char* runBegin, const char*, const char* newEnd) -> const char*
+                       {
+                           size_t whole = size_t(newEnd - runBegin) / recordSize * recordSize;
+                           return whole ? runBegin + whole : nullptr;
+                       });
+    }
+
+    // copies the next size bytes out, e.g. a file header. false if the input is shorter than that
+    bool take(void* dst, size_t size)
+    {
+        if (_map)
+        {
+            if (_mapSize - _mapPos < size)
+                return false;
+            std::memcpy(dst, _map + _mapPos, size);
+            _mapPos += size;
+            return true;
+        }
+        while (_filled - _consumed < size)
+        {
+            Compact();
+            if (!ReadMore())
+                return false;
+        }
+        std::memcpy(dst, _buffer.data() + _consumed, size);
+        _consumed += size;
+        _position += size;
+        return true;
+    }
+
+    // throws the next size bytes away, e.g. input already replayed before a restart. false if there
+    // aren't that many
+    bool skip(uint64_t size)
+    {
+        if (_map)
+        {
+            if (_mapSize - _mapPos < size)
+                return false;
+            _mapPos += size;
+            return true;
+        }
+        while (size)
+        {
+            if (_filled == _consumed)
+            {
+                Compact();
+                if (!ReadMore())
+                    return false;
+            }
+            size_t step = size_t(std::min<uint64_t>(size, _filled - _consumed));
+            _consumed += step;
+            _position += step;
+            size -= step;
+        }
+        return true;
+    }
+
+    // input offset of the end of everything handed out so far
+    uint64_t position() const { return _map ? _mapPos : _position; }
+
+private:
+    // cut(runBegin, newBegin, newEnd) returns the end of the part of [runBegin, newEnd) which can be handed
+    // out, or nullptr to read more first. [newBegin, newEnd) is what the last read() added
+    template <typename Cut>
+    bool NextRun(const char*& begin, const char*& end, Cut&& cut)
+    {
+        if (_map)
+        {
+            if (_mapPos == _mapSize)
+                return false;
+            begin = _map + _mapPos;
+            end = _map + std::min(_mapSize, _mapPos + READ_BLOCK_BYTES);
+            if (end != _map + _mapSize)
+            {
+                const char* runEnd = cut(begin, begin, end);
+                if (!runEnd) // a line or record longer than a block
+                    runEnd = cut(begin, begin, _map + _mapSize);
+                end = runEnd ? runEnd : _map + _mapSize;
+            }
+            _mapPos = size_t(end - _map);
+            return true;
+        }
+
+        Compact(); // keep the partial line or record left over from last time
+        if (_filled) // which may already hold whole ones, after a take()
+        {
+            const char* runEnd = cut(_buffer.data(), _buffer.data(), _buffer.data() + _filled);
+            if (runEnd)
+                return HandOut(begin, end, runEnd);
+        }
+        while (!_eof)
+        {
+            size_t oldFilled = _filled;
+            if (!ReadMore())
+                break;
+            const char* runEnd = cut(_buffer.data(), _buffer.data() + oldFilled, _buffer.data() + _filled);
+            if (runEnd)
+                return HandOut(begin, end, runEnd);
+        }
+        if (_filled == 0)
+            return false;
+        return HandOut(begin, end, _buffer.data() + _filled);
+    }
+
+    bool HandOut(const char*& begin, const char*& end, const char* runEnd)
+    {
+        begin = _buffer.data();
+        end = runEnd;
+        _consumed = size_t(runEnd - begin);
+        _position += _consumed;
+        return true;
+    }
+
+    void Compact()
+    {
+        std::memmove(_buffer.data(), _buffer.data() + _consumed, _filled - _consumed);
+        _filled -= _consumed;
+        _consumed = 0;
+    }
+
+    // false at end of input
+    bool ReadMore()
+    {
+        while (!_eof)
+        {
+            if (_filled == _buffer.size()) // a single line longer than the buffer
+                _buffer.resize(_buffer.size() * 2);
+            ssize_t numRead = read(_fd, _buffer.data() + _filled, _buffer.size() - _filled);
+            if (numRead < 0 && errno == EINTR)
+                continue;
+            if (numRead <= 0)
+                _eof = true;
+            else
+            {
+                _filled += size_t(numRead);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int _fd;
+    const char* _map = nullptr;
+    size_t _mapSize = 0;
+    size_t _mapPos = 0;
+    std::vector<char> _buffer;
+    size_t _filled = 0;
+    size_t _consumed = 0;
+    uint64_t _position = 0; // read() mode only
+    bool _eof = false;
+};
+
+inline bool IsSpace(char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+inline const char* SkipSpace(const char* p, const char* end)
+{
+    while (p < end && IsSpace(*p))
+        ++p;
+    return p;
+}
+
+// plain digits, one unsigned compare per character. nullptr if there are none (value 0) or if they don't
+// fit in 64 bits (value UINT64_MAX), the two ways std::cin >> uint64_t fails
+inline const char* ScanUnsigned(const char* p, const char* end, uint64_t& value)
+{
+    const char* start = p;
+    uint64_t result = 0;
+    for (; p < end; ++p)
+    {
+        uint32_t digit = uint32_t(uint8_t(*p)) - '0';
+        if (digit > 9)
+            break;
+        result = result * 10 + digit;
+    }
+    if (p - start > 19) // 19 digits always fit, longer numbers are checked again the slow way
+    {
+        result = 0;
+        for (const char* q = start; q < p; ++q)
+        {
+            uint32_t digit = uint32_t(uint8_t(*q)) - '0';
+            if (result > (UINT64_MAX - digit) / 10)
+            {
+                value = UINT64_MAX;
+                return nullptr;
+            }
+            result = result * 10 + digit;
+        }
+    }
+    value = result;
+    return p == start ? nullptr : p;
+}
+
+// an optional sign and digits. nullptr if there are no digits (value 0) or if the number doesn't fit in
+// 32 bits (value INT32_MAX or INT32_MIN), again like std::cin
+inline const char* ScanSigned(const char* p, const char* end, int32_t& value)
+{
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        ++p;
+    uint64_t magnitude;
+    p = ScanUnsigned(p, end, magnitude);
+    if (magnitude > uint64_t(INT32_MAX) + negative)
+    {
+        value = negative ? INT32_MIN : INT32_MAX;
+        return nullptr;
+    }
+    value = int32_t(negative ? 0 - magnitude : magnitude);
+    return p;
+}
+
+// the rest of the line is ignored, as the std::cin loop did. memchr is vectorized in glibc
+inline const char* SkipLine(const char* p, const char* end)
+{
+    const void* newline = std::memchr(p, '\n', size_t(end - p));
+    return newline ? static_cast<const char*>(newline) + 1 : end;
+}
+
+// optional trailing symbol on the same line
+inline const char* ScanSymbol(const char* p, const char* end, std::string_view& symbol)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    const char* start = p;
+    while (p < end && !IsSpace(*p))
+        ++p;
+    symbol = std::string_view(start, size_t(p - start));
+    return p;
+}
+
+// parses the message starting at p, returns where the next one starts. fields are separated by any
+// whitespace and an unknown command word only consumes itself, exactly like the old std::cin >> loop.
+// a qty, price or DEPTH count which isn't a number or doesn't fit is what ended that loop after the
+// command it was in: cmd is still filled in, with that field 0 or clamped and any after it 0, and the
+// return is nullptr, meaning cmd is the last command of the input
+inline const char* ParseCommand(const char* p, const char* end, Command& cmd)
+{
+    p = SkipSpace(p, end);
+    if (p == end)
+    {
+        cmd.type = CommandType::None;
+        return end;
+    }
+    // an unsigned std::cin read took a sign too, and a minus wrapped the value around
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+')
+        ++p;
+    p = ScanUnsigned(p, end, cmd.orderId);
+    if (!p)
+    {
+        cmd.type = CommandType::Stop;
+        return end;
+    }
+    if (negative)
+        cmd.orderId = 0 - cmd.orderId;
+
+    p = SkipSpace(p, end);
+    const char* word = p;
+    while (p < end && !IsSpace(*p))
+        ++p;
+    size_t wordLen = size_t(p - word);
+    cmd.symbol = std::string_view();
+    if (wordLen == 6 && std::memcmp(word, "CANCEL", 6) == 0)
+    {
+        cmd.type = CommandType::Cancel;
+        return SkipLine(ScanSymbol(p, end, cmd.symbol), end);
+    }
+    if (wordLen == 5 && std::memcmp(word, "DEPTH", 5) == 0)
+    {
+        cmd.type = CommandType::Depth;
+        cmd.price = 0;
+        p = ScanSigned(SkipSpace(p, end), end, cmd.qty);
+        return p ? SkipLine(ScanSymbol(p, end, cmd.symbol), end) : nullptr;
+    }
+    if (wordLen == 5 && std::memcmp(word, "STATS", 5) == 0)
+    {
+        cmd.type = CommandType::Stats;
+        return SkipLine(ScanSymbol(p, end, cmd.symbol), end);
+    }
+    bool immediate = true;
+    ImmediateKind kind = ImmediateKind::Ioc;
+    if (wordLen == 3 && std::memcmp(word, "IOC", 3) == 0)
+        kind = ImmediateKind::Ioc;
+    else if (wordLen == 3 && std::memcmp(word, "FOK", 3) == 0)
+        kind = ImmediateKind::Fok;
+    else if (wordLen == 6 && std::memcmp(word, "MARKET", 6) == 0)
+        kind = ImmediateKind::Market;
+    else
+        immediate = false;
+    if (immediate) // the side follows as its own word
+    {
+        const char* sideWord = p = SkipSpace(p, end);
+        while (p < end && !IsSpace(*p))
+            ++p;
+        word = sideWord;
+        wordLen = size_t(p - sideWord);
+    }
+
+    bool isBuy = wordLen == 3 && std::memcmp(word, "BUY", 3) == 0;
+    if (isBuy || (wordLen == 4 && std::memcmp(word, "SELL", 4) == 0))
+        cmd.type = immediate ? ImmediateType(kind, isBuy) : isBuy ? CommandType::Buy : CommandType::Sell;
+    else if (!immediate && wordLen == 6 && std::memcmp(word, "REVISE", 6) == 0)
+        cmd.type = CommandType::Revise;
+    else
+    {
+        cmd.type = CommandType::Invalid;
+        return p;
+    }
+
+    cmd.price = 0;
+    p = ScanSigned(SkipSpace(p, end), end, cmd.qty);
+    if (p && !(immediate && kind == ImmediateKind::Market))
+        p = ScanSigned(SkipSpace(p, end), end, cmd.price);
+    return p ? SkipLine(ScanSymbol(p, end, cmd.symbol), end) : nullptr;
+}
+
+// calls onCommand for every text command (including Invalid ones) and onBatchEnd after each run of lines
+template <typename OnCommand, typename OnBatchEnd>
+void ReadText(InputReader& reader, OnCommand&& onCommand, OnBatchEnd&& onBatchEnd)
+{
+    const char* begin;
+    const char* end;
+    while (reader.next(begin, end))
+    {
+        Command cmd;
+        for (const char* p = begin; p < end;)
+        {
+            p = ParseCommand(p, end, cmd);
+            if (cmd.type == CommandType::Stop)
+                return;
+            if (cmd.type != CommandType::None)
+                onCommand(cmd);
+            if (!p)
+                return;
+        }
+        onBatchEnd();
+    }
+}
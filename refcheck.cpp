@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "command.h"
+#include "flowgen.h"
+#include "market.h"
+#include "protocol.h"
+#include "reader.h"
+#include "refmarket.h"
+#include "sink.h"
+
+// differential check of the Market against the ReferenceMarket in refmarket.h. each of --streams seeded
+// flows (flowgen.h, seeds --seed, --seed + 1, ...) gets what the generator doesn't make on its own mixed
+// in: revises that cross, cancels and revises of ids that were never used, large orders that sweep several
+// levels, and DEPTH requests. both engines run the stream and their events are compared record by record.
+// on the first difference the stream is shrunk to a small input that still differs, which goes to --out as
+// text commands, and the first differing event is printed. streams that agree are run through both engines
+// again into a NullSink, to compare their throughput on the same input.
+//   refcheck --streams 50 --messages 200000 --depth-updates --amend --ladder 64
+// --sample <file> instead runs the reference alone over a file of text commands and writes its output to
+// stdout, which make check compares with what the first main.cpp wrote for test1.txt and test2.txt
+
+using BenchClock = std::chrono::steady_clock;
+
+struct CheckConfig
+{
+    MarketConfig market;
+    size_t batch = 0; // > 0 runs the Market through ProcessBatch, this many commands at a time
+};
+
+// the generator's flow with the extra cases mixed in, from a random stream of their own so the flow itself
+// is the one gen would write
+std::vector<Command> MakeStream(const FlowConfig& flow)
+{
+    std::vector<Command> commands;
+    commands.reserve(flow.messages + flow.messages / 32);
+    FlowGenerator generator(flow);
+    FlowRandom random(flow.seed ^ 0xD1FFull);
+    uint64_t nextId = flow.firstId + flow.messages; // past anything the generator hands out
+    uint64_t unknownId = UINT64_MAX / 2; // never used at all
+    int32_t lastPrice = flow.startPrice;
+    for (Command cmd; generator.Next(cmd);)
+    {
+        if (cmd.type == CommandType::Buy || cmd.type == CommandType::Sell)
+            lastPrice = cmd.price;
+        if (cmd.type == CommandType::Revise && random.Below(4) == 0) // anywhere in the band, often across the book
+            cmd.price = lastPrice + int32_t(random.Below(uint64_t(2 * flow.band + 1))) - flow.band;
+        commands.push_back(cmd);
+
+        Command extra = {};
+        switch (random.Below(128))
+        {
+        case 0:
+            extra.type = CommandType::Cancel;
+            extra.orderId = unknownId++;
+            break;
+        case 1:
+            extra.type = CommandType::Revise;
+            extra.orderId = unknownId++;
+            extra.qty = 1;
+            extra.price = lastPrice;
+            break;
+        case 2:
+        case 3:
+        {
+            bool isBuy = random.Below(2);
+            extra.type = isBuy ? CommandType::Buy : CommandType::Sell;
+            extra.orderId = nextId++;
+            extra.qty = flow.maxQty * int32_t(5 + random.Below(20));
+            int32_t through = int32_t(random.Below(uint64_t(flow.band + 1)));
+            extra.price = isBuy ? lastPrice + through : lastPrice - through;
+            break;
+        }
+        case 4:
+            extra.type = CommandType::Depth;
+            extra.orderId = nextId++;
+            extra.qty = int32_t(random.Below(10));
+            break;
+        default:
+            continue;
+        }
+        commands.push_back(extra);
+    }
+    return commands;
+}
+
+std::vector<BinaryEvent> ReferenceEvents(std::span<const Command> commands, const CheckConfig& config)
+{
+    EventBuffer capture;
+    ReferenceMarket market(capture, config.market);
+    for (const Command& cmd : commands)
+        market.Process(cmd);
+    return std::move(capture.events);
+}
+
+void RunMarket(Market& market, std::span<const Command> commands, size_t batch)
+{
+    if (batch)
+    {
+        for (size_t ii = 0; ii < commands.size(); ii += batch)
+            market.ProcessBatch(commands.subspan(ii, std::min(batch, commands.size() - ii)));
+    }
+    else
+    {
+        for (const Command& cmd : commands)
+            market.Process(cmd);
+    }
+}
+
+std::vector<BinaryEvent> MarketEvents(std::span<const Command> commands, const CheckConfig& config)
+{
+    EventBuffer capture;
+    Market market(capture, config.market);
+    RunMarket(market, commands, config.batch);
+    return std::move(capture.events);
+}
+
+// index of the first event that differs, or SIZE_MAX if the runs agree
+size_t FirstDifference(const std::vector<BinaryEvent>& expected, const std::vector<BinaryEvent>& got)
+{
+    size_t common = std::min(expected.size(), got.size());
+    for (size_t ii = 0; ii < common; ++ii)
+    {
+        if (std::memcmp(&expected[ii], &got[ii], sizeof(BinaryEvent)) != 0)
+            return ii;
+    }
+    return expected.size() == got.size() ? SIZE_MAX : common;
+}
+
+bool Differs(std::span<const Command> commands, const CheckConfig& config)
+{
+    return FirstDifference(ReferenceEvents(commands, config), MarketEvents(commands, config)) != SIZE_MAX;
+}
+
+// drops runs of commands for as long as what's left still differs, halving the run length down to single
+// commands, and starts over while that keeps removing anything
+std::vector<Command> Shrink(std::vector<Command> commands, const CheckConfig& config)
+{
+    for (size_t before = 0; before != commands.size();)
+    {
+        before = commands.size();
+        for (size_t chunk = std::max<size_t>(1, commands.size() / 2); chunk > 0; chunk /= 2)
+        {
+            for (size_t start = 0; start < commands.size();)
+            {
+                std::vector<Command> candidate(commands.begin(), commands.begin() + start);
+                candidate.insert(candidate.end(), commands.begin() + std::min(start + chunk, commands.size()), commands.end());
+                if (!candidate.empty() && Differs(candidate, config))
+                    commands = std::move(candidate);
+                else
+                    start += chunk;
+            }
+        }
+    }
+    return commands;
+}
+
+bool WriteCommands(const std::vector<Command>& commands, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+    char line[MAX_COMMAND_BYTES];
+    for (const Command& cmd : commands)
+    {
+        char* end = FormatCommand(line, cmd);
+        fprintf(file, "%.*s\n", int(end - line), line);
+    }
+    return fclose(file) == 0;
+}
+
+// the events around the first difference, as text
+void PrintDifference(const std::vector<BinaryEvent>& expected, const std::vector<BinaryEvent>& got, size_t at)
+{
+    BufferedSink out(STDOUT_FILENO);
+    auto print = [&](const char* name, const std::vector<BinaryEvent>& events)
+    {
+        out.Flush();
+        printf("%s, from event %zu:\n", name, at);
+        fflush(stdout);
+        for (size_t ii = at; ii < std::min(events.size(), at + 5); ++ii)
+            DispatchEvent(events[ii], out);
+        if (at >= events.size())
+            printf("(no more events)\n");
+        out.Flush();
+    };
+    print("reference", expected);
+    print("market", got);
+}
+
+bool RunSample(const char* path, const CheckConfig& config)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return false;
+    }
+    {
+        InputReader reader(fd);
+        BufferedSink out(STDOUT_FILENO);
+        ReferenceMarket market(out, config.market);
+        ReadText(reader, [&](const Command& cmd) { market.Process(cmd); }, [&] { out.Flush(); });
+    }
+    close(fd);
+    return true;
+}
+
+template <typename Run>
+double Time(Run&& run)
+{
+    BenchClock::time_point start = BenchClock::now();
+    run();
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    FlowConfig flow;
+    flow.messages = 100000;
+    flow.immediatePercent = 20;
+    CheckConfig config;
+    size_t streams = 20;
+    const char* outPath = "refcheck-repro.txt";
+    const char* samplePath = nullptr;
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        std::string arg = argv[ii];
+        if (ParseFlowOption(argc, argv, ii, flow))
+            continue;
+        if (arg == "--streams" && ii + 1 < argc)
+            streams = std::stoul(argv[++ii]);
+        else if (arg == "--ladder" && ii + 1 < argc)
+            config.market.ladderBand = std::stoul(argv[++ii]);
+        else if (arg == "--hashed-ids")
+            config.market.directIds = false;
+        else if (arg == "--depth-updates")
+            config.market.depthUpdates = true;
+        else if (arg == "--amend")
+            config.market.amendInPlace = true;
+        else if (arg == "--batch" && ii + 1 < argc)
+            config.batch = std::stoul(argv[++ii]);
+        else if (arg == "--out" && ii + 1 < argc)
+            outPath = argv[++ii];
+        else if (arg == "--sample" && ii + 1 < argc)
+            samplePath = argv[++ii];
+        else
+        {
+            fprintf(stderr, "usage: %s %s\n"
+                            "          [--streams N] [--ladder TICKS] [--hashed-ids] [--depth-updates] [--amend] [--batch COMMANDS]\n"
+                            "          [--out FILE] [--sample FILE]\n", argv[0], FLOW_USAGE);
+            return 1;
+        }
+    }
+    if (samplePath)
+        return RunSample(samplePath, config) ? 0 : 1;
+    if (!CheckFlowConfig(flow) || flow.symbols)
+    {
+        fprintf(stderr, "add + cancel + revise and immediate must each be at most 100, band and max qty at least 1, and no --symbols\n");
+        return 1;
+    }
+
+    size_t totalCommands = 0;
+    size_t totalEvents = 0;
+    double referenceSeconds = 0;
+    double marketSeconds = 0;
+    uint64_t firstSeed = flow.seed;
+    for (size_t stream = 0; stream < streams; ++stream)
+    {
+        flow.seed = firstSeed + stream;
+        std::vector<Command> commands = MakeStream(flow);
+        std::vector<BinaryEvent> expected = ReferenceEvents(commands, config);
+        std::vector<BinaryEvent> got = MarketEvents(commands, config);
+        if (FirstDifference(expected, got) != SIZE_MAX)
+        {
+            printf("seed %llu: the Market differs from the reference, shrinking %zu commands\n", (unsigned long long)flow.seed,
+                   commands.size());
+            fflush(stdout);
+            commands = Shrink(std::move(commands), config);
+            expected = ReferenceEvents(commands, config);
+            got = MarketEvents(commands, config);
+            PrintDifference(expected, got, FirstDifference(expected, got));
+            if (WriteCommands(commands, outPath))
+                printf("%zu commands that still differ are in %s\n", commands.size(), outPath);
+            else
+                fprintf(stderr, "can't write %s\n", outPath);
+            return 1;
+        }
+        totalCommands += commands.size();
+        totalEvents += expected.size();
+
+        NullSink sink;
+        referenceSeconds += Time([&]
+                                 {
+                                     ReferenceMarket market(sink, config.market);
+                                     for (const Command& cmd : commands)
+                                         market.Process(cmd);
+                                 });
+        marketSeconds += Time([&]
+                              {
+                                  Market market(sink, config.market);
+                                  RunMarket(market, commands, config.batch);
+                              });
+    }
+    printf("%zu streams, %zu commands, %zu events: the Market matches the reference\n", streams, totalCommands, totalEvents);
+    if (totalCommands)
+    {
+        double referenceRate = double(totalCommands) / referenceSeconds;
+        double marketRate = double(totalCommands) / marketSeconds;
+        printf("reference %.2f M msg/s  market %.2f M msg/s  (%.2fx)\n", referenceRate / 1e6, marketRate / 1e6,
+               marketRate / referenceRate);
+    }
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "command.h"
+#include "market.h"
+#include "sink.h"
+
+// the Market from the first main.cpp, frozen as the reference refcheck holds the real Market to. its
+// AddOrder, ReviseOrder, CancelOrder, MatchOrders and TryMatchBests are that code as it was, with only the
+// printfs turned into sink calls and three fixes for undefined behaviour, each marked "was:":
+//  - TryMatchBests read both front orders' ids after popping them, when their qty was equal
+//  - a cancel left an emptied level in its map, and TryMatchBests then took front() of the empty deque
+//  - ReviseOrder wrote through its reference into _idToSideLevel after AddOrder could have erased it
+// what the protocol gained since (depth updates, --amend, DEPTH, IOC, FOK and MARKET) is added around it,
+// in the same plain style. don't optimize any of it, and don't "fix" the frozen part to follow the Market:
+// if they disagree, the Market is what's wrong until shown otherwise.
+// like the original it assumes the ids of live orders are unique, a reused id cancels whichever comes first
+
+class ReferenceMarket
+{
+public:
+    explicit ReferenceMarket(EventSink& sink, const MarketConfig& config = MarketConfig())
+        : _sink(sink)
+        , _depthUpdates(config.depthUpdates)
+        , _amendInPlace(config.amendInPlace)
+    {
+    }
+
+    void Process(const Command& cmd)
+    {
+        switch (cmd.type)
+        {
+        case CommandType::Buy:
+        case CommandType::Sell:
+            AddOrder(cmd.orderId, cmd.type == CommandType::Buy, cmd.qty, cmd.price);
+            break;
+        case CommandType::Revise:
+            ReviseOrder(cmd.orderId, cmd.qty, cmd.price);
+            break;
+        case CommandType::Cancel:
+            CancelOrder(cmd.orderId);
+            break;
+        case CommandType::Depth:
+            PublishBook(cmd.orderId, size_t(std::max(cmd.qty, 0)));
+            break;
+        case CommandType::Invalid:
+            _sink.OnParseError();
+            break;
+        default:
+            if (IsImmediate(cmd.type))
+                ImmediateOrder(ImmediateKindOf(cmd.type), cmd.orderId, ImmediateIsBuy(cmd.type), cmd.qty, cmd.price);
+            break;
+        }
+        for (const auto& [isBuy, price] : _changedLevels)
+        {
+            Totals totals = isBuy ? LevelTotals(_bidLevels, price) : LevelTotals(_askLevels, price);
+            _sink.OnDepth(isBuy, price, totals.qty, totals.orders);
+        }
+        _changedLevels.clear();
+    }
+
+private:
+    struct Order
+    {
+        Order(uint64_t o, int32_t p, int32_t q) : orderId(o), price(p), qty(q) {}
+        uint64_t orderId;
+        int32_t price;
+        int32_t qty;
+    };
+
+    struct SideLevel
+    {
+        SideLevel() = default;
+        SideLevel(bool ib, int32_t p) : isBuy(ib), price(p) {}
+        bool isBuy;
+        int32_t price;
+    };
+
+    using LevelQueue = std::deque<Order>;
+
+    // the frozen part
+
+    void AddOrder(uint64_t orderId, bool isBuy, int32_t qty, int32_t price)
+    {
+        LevelQueue* levelQueue;
+        if (isBuy)
+            levelQueue = &_bidLevels[price]; // construct if not exist
+        else
+            levelQueue = &_askLevels[price];
+        levelQueue->emplace_back(orderId, price, qty);
+        auto sideLevel = SideLevel(isBuy, price);
+        _idToSideLevel[orderId] = sideLevel;
+        LevelChanged(isBuy, price);
+
+        _sink.OnOrder(isBuy, qty, price, orderId);
+
+        MatchOrders(isBuy);
+    }
+
+    void ReviseOrder(uint64_t orderId, int32_t qty, int32_t price)
+    {
+        auto it = _idToSideLevel.find(orderId);
+        if (it != _idToSideLevel.end())
+        {
+            SideLevel sideLevel = it->second; // was: SideLevel&
+            if (AmendOrder(sideLevel, orderId, qty, price))
+                return;
+            CancelOrder(sideLevel, orderId);
+            AddOrder(orderId, sideLevel.isBuy, qty, price); // cannot change side with revise
+            // was: sideLevel.price = price; which AddOrder has already stored, unless the order traded away
+        }
+    }
+
+    void CancelOrder(SideLevel sideLevel, uint64_t orderId)
+    {
+        LevelQueue* levelQueue = nullptr;
+        if (sideLevel.isBuy)
+        {
+            auto bidLevelIt = _bidLevels.find(sideLevel.price);
+            if (bidLevelIt != _bidLevels.end())
+                levelQueue = &bidLevelIt->second;
+        }
+        else
+        {
+            auto askLevelIt = _askLevels.find(sideLevel.price);
+            if (askLevelIt != _askLevels.end())
+                levelQueue = &askLevelIt->second;
+        }
+        if (!levelQueue)
+            return; // should never happen
+        auto orderIt = std::find_if(levelQueue->begin(), levelQueue->end(), [orderId](const Order& order)
+                                    {
+                                        return order.orderId == orderId;
+                                    });
+        int32_t qtyCancelled = orderIt->qty;
+        levelQueue->erase(orderIt);
+        if (levelQueue->empty()) // was: left in the map
+        {
+            if (sideLevel.isBuy)
+                _bidLevels.erase(sideLevel.price);
+            else
+                _askLevels.erase(sideLevel.price);
+        }
+        LevelChanged(sideLevel.isBuy, sideLevel.price);
+        _sink.OnCancel(orderId, qtyCancelled);
+    }
+
+    void CancelOrder(uint64_t orderId)
+    {
+        auto it = _idToSideLevel.find(orderId);
+        if (it != _idToSideLevel.end())
+        {
+            SideLevel sideLevel = it->second;
+            CancelOrder(sideLevel, orderId);
+            _idToSideLevel.erase(it);
+        }
+    }
+
+    void MatchOrders(bool aggressorIsBuy)
+    {
+        // match all orders which can match and print them
+        while (TryMatchBests(aggressorIsBuy))
+            continue;
+    }
+
+    bool TryMatchBests(bool aggressorIsBuy)
+    {
+        auto bestBidLevelIt = _bidLevels.begin();
+        auto bestAskLevelIt = _askLevels.begin();
+        if (bestBidLevelIt == _bidLevels.end())
+            return false;
+        if (bestAskLevelIt == _askLevels.end())
+            return false;
+        int32_t bestBidPrice = bestBidLevelIt->first;
+        int32_t bestAskPrice = bestAskLevelIt->first;
+        if (bestBidPrice < bestAskPrice)
+            return false;
+
+        // else, we can match
+        LevelQueue& bestBidQueue = bestBidLevelIt->second;
+        LevelQueue& bestAskQueue = bestAskLevelIt->second;
+        Order& bestBidFrontOrder = bestBidQueue.front();
+        Order& bestAskFrontOrder = bestAskQueue.front();
+        uint64_t aggrId = aggressorIsBuy ? bestBidFrontOrder.orderId : bestAskFrontOrder.orderId;
+        uint64_t passiveId = aggressorIsBuy ? bestAskFrontOrder.orderId : bestBidFrontOrder.orderId;
+        int32_t tradePrice = aggressorIsBuy ? bestAskFrontOrder.price : bestBidFrontOrder.price;
+        if (bestBidFrontOrder.qty > bestAskFrontOrder.qty)
+        {
+            int32_t tradeQty = bestAskFrontOrder.qty;
+            bestBidFrontOrder.qty -= tradeQty;
+            uint64_t idToDelete = bestAskFrontOrder.orderId;
+            bestAskQueue.pop_front();
+            _idToSideLevel.erase(idToDelete);
+            _sink.OnTrade(aggrId, passiveId, tradeQty, tradePrice);
+        }
+        else if (bestBidFrontOrder.qty < bestAskFrontOrder.qty)
+        {
+            int32_t tradeQty = bestBidFrontOrder.qty;
+            bestAskFrontOrder.qty -= tradeQty;
+            uint64_t idToDelete = bestBidFrontOrder.orderId;
+            bestBidQueue.pop_front();
+            _idToSideLevel.erase(idToDelete);
+            _sink.OnTrade(aggrId, passiveId, tradeQty, tradePrice);
+        }
+        else // they're equal
+        {
+            int32_t tradeQty = bestBidFrontOrder.qty; // bid and ask qty same anyway
+            uint64_t bidId = bestBidFrontOrder.orderId; // was: read from the orders after the pops
+            uint64_t askId = bestAskFrontOrder.orderId;
+            bestBidQueue.pop_front();
+            bestAskQueue.pop_front();
+            _idToSideLevel.erase(bidId);
+            _idToSideLevel.erase(askId);
+            _sink.OnTrade(aggrId, passiveId, tradeQty, tradePrice);
+        }
+        if (bestAskQueue.empty())
+            _askLevels.erase(bestAskLevelIt);
+        if (bestBidQueue.empty())
+            _bidLevels.erase(bestBidLevelIt);
+        LevelChanged(true, bestBidPrice);
+        LevelChanged(false, bestAskPrice);
+        return true;
+        // TRADE <AGGRESSIVE ID> <PASSIVE ID> <QTY> <PRICE>
+    }
+
+    // added since
+
+    struct Totals
+    {
+        int64_t qty = 0;
+        uint32_t orders = 0;
+    };
+
+    // fn(levels) on one side's map, whichever type it is
+    template <typename Fn>
+    void OnSide(bool isBuy, Fn&& fn)
+    {
+        if (isBuy)
+            fn(_bidLevels);
+        else
+            fn(_askLevels);
+    }
+
+    template <typename Levels>
+    static Totals LevelTotals(Levels& levels, int32_t price)
+    {
+        Totals totals;
+        auto it = levels.find(price);
+        if (it == levels.end())
+            return totals;
+        for (const Order& order : it->second)
+        {
+            totals.qty += order.qty;
+            ++totals.orders;
+        }
+        return totals;
+    }
+
+    void LevelChanged(bool isBuy, int32_t price)
+    {
+        if (!_depthUpdates)
+            return;
+        for (const auto& [changedIsBuy, changedPrice] : _changedLevels)
+        {
+            if (changedIsBuy == isBuy && changedPrice == price)
+                return;
+        }
+        _changedLevels.emplace_back(isBuy, price);
+    }
+
+    // --amend: a revise that keeps the price and lowers the qty, done in place. false if it isn't one
+    bool AmendOrder(SideLevel sideLevel, uint64_t orderId, int32_t qty, int32_t price)
+    {
+        if (!_amendInPlace || price != sideLevel.price || qty <= 0)
+            return false;
+        bool amended = false;
+        OnSide(sideLevel.isBuy, [&](auto& levels)
+               {
+                   LevelQueue& level = levels[price];
+                   auto orderIt = std::find_if(level.begin(), level.end(), [orderId](const Order& order) { return order.orderId == orderId; });
+                   if (qty < orderIt->qty)
+                   {
+                       orderIt->qty = qty;
+                       amended = true;
+                   }
+               });
+        if (!amended)
+            return false;
+        LevelChanged(sideLevel.isBuy, price);
+        _sink.OnRevise(qty, price, orderId);
+        return true;
+    }
+
+    void ImmediateOrder(ImmediateKind kind, uint64_t orderId, bool isBuy, int32_t qty, int32_t price)
+    {
+        _sink.OnImmediate(kind, isBuy, qty, price, orderId);
+        bool unlimited = kind == ImmediateKind::Market;
+        auto within = [&](int32_t levelPrice) { return unlimited || (isBuy ? levelPrice <= price : levelPrice >= price); };
+        OnSide(!isBuy, [&](auto& levels)
+               {
+                   if (kind == ImmediateKind::Fok)
+                   {
+                       int64_t available = 0;
+                       for (auto& [levelPrice, level] : levels)
+                       {
+                           if (!within(levelPrice))
+                               break;
+                           for (const Order& order : level)
+                               available += order.qty;
+                       }
+                       if (available < qty)
+                           return;
+                   }
+                   while (qty > 0 && !levels.empty() && within(levels.begin()->first))
+                   {
+                       int32_t levelPrice = levels.begin()->first;
+                       LevelQueue& queue = levels.begin()->second;
+                       while (qty > 0 && !queue.empty())
+                       {
+                           Order& passive = queue.front();
+                           int32_t tradeQty = std::min(qty, passive.qty);
+                           qty -= tradeQty;
+                           passive.qty -= tradeQty;
+                           uint64_t passiveId = passive.orderId;
+                           if (passive.qty == 0)
+                           {
+                               _idToSideLevel.erase(passiveId);
+                               queue.pop_front();
+                           }
+                           _sink.OnTrade(orderId, passiveId, tradeQty, levelPrice);
+                       }
+                       if (queue.empty())
+                           levels.erase(levels.begin());
+                       LevelChanged(!isBuy, levelPrice);
+                   }
+               });
+        if (qty > 0)
+            _sink.OnCancel(orderId, qty);
+    }
+
+    void PublishBook(uint64_t requestId, size_t levels)
+    {
+        uint32_t bidLevels = uint32_t(std::min(levels, _bidLevels.size()));
+        uint32_t askLevels = uint32_t(std::min(levels, _askLevels.size()));
+        _sink.OnBook(requestId, bidLevels, askLevels);
+        auto publish = [&](bool isBuy, auto& sideLevels, uint32_t count)
+        {
+            for (auto it = sideLevels.begin(); count > 0; ++it, --count)
+            {
+                Totals totals = LevelTotals(sideLevels, it->first);
+                _sink.OnBookLevel(isBuy, it->first, totals.qty, totals.orders);
+            }
+        };
+        publish(true, _bidLevels, bidLevels);
+        publish(false, _askLevels, askLevels);
+    }
+
+    EventSink& _sink;
+    bool _depthUpdates;
+    bool _amendInPlace;
+    std::unordered_map<uint64_t, SideLevel> _idToSideLevel;
+
+    // bid levels are in descending order, front is best/highest
+    std::map<int32_t, LevelQueue, std::greater<int32_t>> _bidLevels;
+    // ask levels are in ascending order, front is best/lowest
+    std::map<int32_t, LevelQueue> _askLevels;
+    std::vector<std::pair<bool, int32_t>> _changedLevels;
+};
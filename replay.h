@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "command.h"
+#include "market.h"
+#include "protocol.h"
+#include "reader.h"
+#include "sink.h"
+
+// replay mode for backtests: every input file is an independent book, run through its own Market into its
+// own output file, <out dir>/<input file name>.out, exactly as `trade <file> > <out file>` would have
+// written it. files are spread over a pool of worker threads, biggest first and dealt round robin, and a
+// worker that runs out steals from the back of the others' queues, so one huge day doesn't leave the rest
+// of the pool idle at the end. a summary of the throughput and of how the work spread goes to stdout
+
+struct ReplayConfig
+{
+    std::string outDir;
+    size_t numWorkers = 0; // one per hardware thread
+    bool binaryIn = false;
+    bool binaryOut = false;
+    bool nullOutput = false; // nothing is written, for timing the matching alone
+};
+
+class FileReplay
+{
+public:
+    FileReplay(const MarketConfig& marketConfig, const ReplayConfig& config)
+        : _marketConfig(marketConfig)
+        , _config(config)
+    {
+        if (!_config.numWorkers)
+            _config.numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    FileReplay(const FileReplay&) = delete;
+    FileReplay& operator=(const FileReplay&) = delete;
+
+    // paths are input files, or directories whose regular files are all inputs. false without replaying
+    // anything if one is missing or two would write the same output file, or once done if any file failed
+    bool Run(const std::vector<std::string>& paths)
+    {
+        if (!CollectJobs(paths))
+            return false;
+        if (!_config.nullOutput && mkdir(_config.outDir.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            perror(_config.outDir.c_str());
+            return false;
+        }
+        std::sort(_jobs.begin(), _jobs.end(), [](const Job& a, const Job& b) { return a.bytes > b.bytes; });
+        size_t numWorkers = std::min(_config.numWorkers, std::max<size_t>(_jobs.size(), 1));
+        for (size_t ii = 0; ii < numWorkers; ++ii)
+            _workers.push_back(std::make_unique<Worker>());
+        for (size_t ii = 0; ii < _jobs.size(); ++ii)
+            _workers[ii % numWorkers]->queue.push_back(ii);
+
+        ReplayClock::time_point start = ReplayClock::now();
+        std::vector<std::thread> threads;
+        for (size_t ii = 0; ii < numWorkers; ++ii)
+            threads.emplace_back([this, ii] { Loop(ii); });
+        for (std::thread& thread : threads)
+            thread.join();
+        PrintSummary(Seconds(ReplayClock::now() - start));
+        return !_failed;
+    }
+
+private:
+    using ReplayClock = std::chrono::steady_clock;
+
+    static double Seconds(ReplayClock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    struct Job
+    {
+        std::string inputPath;
+        std::string outputPath;
+        uint64_t bytes;
+        // filled in by the worker that ran it
+        uint64_t commands = 0;
+        double seconds = 0;
+    };
+
+    struct Worker
+    {
+        std::mutex lock; // the owner pops the front, thieves take the back
+        std::deque<size_t> queue; // indexes into _jobs
+        size_t files = 0;
+        size_t stolen = 0;
+        uint64_t commands = 0;
+        double busySeconds = 0;
+    };
+
+    bool CollectJobs(const std::vector<std::string>& paths)
+    {
+        bool ok = true;
+        for (const std::string& path : paths)
+        {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+            {
+                perror(path.c_str());
+                ok = false;
+            }
+            else if (S_ISDIR(st.st_mode))
+                ok = AddDirectory(path) && ok;
+            else
+                AddJob(path, std::string(BaseName(path)), uint64_t(st.st_size));
+        }
+        std::unordered_set<std::string> outputs;
+        for (const Job& job : _jobs)
+        {
+            if (!_config.nullOutput && !outputs.insert(job.outputPath).second)
+            {
+                fprintf(stderr, "%s: more than one input would be replayed into %s\n", job.inputPath.c_str(), job.outputPath.c_str());
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // the directory's regular files in name order, skipping dot files. no recursion
+    bool AddDirectory(const std::string& dir)
+    {
+        DIR* handle = opendir(dir.c_str());
+        if (!handle)
+        {
+            perror(dir.c_str());
+            return false;
+        }
+        std::vector<std::string> names;
+        while (dirent* entry = readdir(handle))
+        {
+            if (entry->d_name[0] != '.')
+                names.emplace_back(entry->d_name);
+        }
+        closedir(handle);
+        std::sort(names.begin(), names.end());
+        for (const std::string& name : names)
+        {
+            std::string path = dir + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                AddJob(path, name, uint64_t(st.st_size));
+        }
+        return true;
+    }
+
+    static std::string_view BaseName(std::string_view path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string_view::npos ? path : path.substr(slash + 1);
+    }
+
+    void AddJob(const std::string& inputPath, const std::string& name, uint64_t bytes)
+    {
+        Job& job = _jobs.emplace_back();
+        job.inputPath = inputPath;
+        job.outputPath = _config.outDir + "/" + name + ".out";
+        job.bytes = bytes;
+    }
+
+    // next job for worker index: its own biggest, or else another's smallest. false when there are none
+    bool NextJob(size_t index, size_t& job)
+    {
+        Worker& self = *_workers[index];
+        {
+            std::lock_guard<std::mutex> guard(self.lock);
+            if (!self.queue.empty())
+            {
+                job = self.queue.front();
+                self.queue.pop_front();
+                return true;
+            }
+        }
+        for (size_t step = 1; step < _workers.size(); ++step)
+        {
+            Worker& victim = *_workers[(index + step) % _workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.queue.empty())
+            {
+                job = victim.queue.back();
+                victim.queue.pop_back();
+                ++self.stolen;
+                return true;
+            }
+        }
+        return false; // nothing gets queued once the threads are running, so empty stays empty
+    }
+
+    void Loop(size_t index)
+    {
+        Worker& self = *_workers[index];
+        for (size_t jobIndex; NextJob(index, jobIndex);)
+        {
+            Job& job = _jobs[jobIndex];
+            ReplayClock::time_point start = ReplayClock::now();
+            if (!ReplayFile(job))
+                _failed = true;
+            job.seconds = Seconds(ReplayClock::now() - start);
+            ++self.files;
+            self.commands += job.commands;
+            self.busySeconds += job.seconds;
+        }
+    }
+
+    // the single book path of main.cpp without the journal and snapshots
+    bool ReplayFile(Job& job)
+    {
+        int inFd = open(job.inputPath.c_str(), O_RDONLY);
+        if (inFd < 0)
+        {
+            perror(job.inputPath.c_str());
+            return false;
+        }
+        int outFd = -1;
+        if (!_config.nullOutput)
+        {
+            outFd = open(job.outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (outFd < 0)
+            {
+                perror(job.outputPath.c_str());
+                close(inFd);
+                return false;
+            }
+        }
+        bool ok = true;
+        {
+            InputReader reader(inFd);
+            std::unique_ptr<EventSink> sink;
+            if (_config.nullOutput)
+                sink = std::make_unique<NullSink>();
+            else if (_config.binaryOut)
+                sink = std::make_unique<BinarySink>(outFd);
+            else
+                sink = std::make_unique<BufferedSink>(outFd);
+            Market market(*sink, _marketConfig);
+            auto process = [&](const Command& cmd)
+            {
+                market.Process(cmd);
+                ++job.commands;
+            };
+            auto flush = [&] { sink->Flush(); };
+            if (_config.binaryIn)
+                ok = ReadBinary(reader, process, flush);
+            else
+                ReadText(reader, process, flush);
+            flush();
+            if (!ok)
+                fprintf(stderr, "%s: not a version %u binary command file\n", job.inputPath.c_str(), unsigned(BINARY_VERSION));
+        }
+        if (outFd >= 0)
+            close(outFd);
+        close(inFd);
+        return ok;
+    }
+
+    void PrintSummary(double wallSeconds) const
+    {
+        uint64_t commands = 0;
+        uint64_t bytes = 0;
+        const Job* slowest = nullptr;
+        for (const Job& job : _jobs)
+        {
+            commands += job.commands;
+            bytes += job.bytes;
+            if (!slowest || job.seconds > slowest->seconds)
+                slowest = &job;
+        }
+        printf("replayed %zu files, %" PRIu64 " commands, %.1f MB in %.3f s with %zu workers: %.2f M msg/s  %.1f MB/s\n",
+               _jobs.size(), commands, double(bytes) / 1e6, wallSeconds, _workers.size(),
+               double(commands) / wallSeconds / 1e6, double(bytes) / wallSeconds / 1e6);
+        double busiest = 0;
+        double idlest = wallSeconds;
+        for (size_t ii = 0; ii < _workers.size(); ++ii)
+        {
+            const Worker& worker = *_workers[ii];
+            printf("worker %zu: %zu files (%zu stolen)  %" PRIu64 " commands  busy %.3f s\n", ii, worker.files,
+                   worker.stolen, worker.commands, worker.busySeconds);
+            busiest = std::max(busiest, worker.busySeconds);
+            idlest = std::min(idlest, worker.busySeconds);
+        }
+        if (slowest)
+            printf("busiest worker %.3f s, idlest %.3f s. slowest file %s, %.3f s\n", busiest, idlest,
+                   slowest->inputPath.c_str(), slowest->seconds);
+    }
+
+    MarketConfig _marketConfig;
+    ReplayConfig _config;
+    std::vector<Job> _jobs; // each touched only by the worker running it, once the threads start
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<bool> _failed = false;
+};
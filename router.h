@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <semaphore>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "command.h"
+#include "market.h"
+#include "reader.h"
+#include "sink.h"
+
+// multi-symbol mode: one Market per symbol, spread over N worker threads which share no mutable state.
+// the reading thread parses a batch of commands and routes each to the worker owning its symbol (symbols
+// are dealt out round robin as they first appear). workers match their share of the batch in parallel,
+// while the reading thread parses the next batch and writes out the previous one, putting each command's
+// output back in input order. so the output is the same as running each symbol through its own trade
+// process, interleaved as the input was.
+
+constexpr size_t ROUTER_BATCH_COMMANDS = 16 * 1024;
+
+// growable output buffer, without the zero filling std::vector<char>::resize would do
+class ByteBuffer
+{
+public:
+    size_t size() const { return _size; }
+    const char* data() const { return _data.get(); }
+    void clear() { _size = 0; }
+
+    // room for at least len more bytes, committed with commit()
+    char* reserveTail(size_t len)
+    {
+        if (_size + len > _capacity)
+        {
+            size_t newCapacity = std::max(_capacity * 2, _size + len);
+            std::unique_ptr<char[]> newData(new char[newCapacity]);
+            if (_size)
+                std::memcpy(newData.get(), _data.get(), _size);
+            _data = std::move(newData);
+            _capacity = newCapacity;
+        }
+        return _data.get() + _size;
+    }
+
+    void commit(const char* tailEnd) { _size = size_t(tailEnd - _data.get()); }
+
+    void append(const char* src, size_t len)
+    {
+        char* tail = reserveTail(len);
+        std::memcpy(tail, src, len);
+        commit(tail + len);
+    }
+
+    // drops the first len bytes, e.g. what a write() took
+    void consume(size_t len)
+    {
+        _size -= len;
+        if (_size)
+            std::memmove(_data.get(), _data.get() + len, _size);
+    }
+
+private:
+    std::unique_ptr<char[]> _data;
+    size_t _size = 0;
+    size_t _capacity = 0;
+};
+
+// text output of one symbol's book, with the symbol at the end of every line so the merged stream can be
+// told apart. an unnamed symbol gets no suffix, which keeps single-book output unchanged
+class SymbolSink : public EventSink
+{
+public:
+    SymbolSink(std::string_view symbol, ByteBuffer*& out)
+        : _suffix(symbol.empty() ? std::string() : " " + std::string(symbol))
+        , _out(out)
+    {
+    }
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        EndLine(FormatOrder(Room(), isBuy, qty, price, orderId));
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override { EndLine(FormatRevise(Room(), qty, price, orderId)); }
+    void OnCancel(uint64_t orderId, int32_t qty) override { EndLine(FormatCancel(Room(), orderId, qty)); }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        EndLine(FormatTrade(Room(), aggressorId, passiveId, qty, price));
+    }
+
+    void OnParseError() override { EndLine(FormatParseError(Room())); }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        EndLine(FormatImmediate(Room(), kind, isBuy, qty, price, orderId));
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        EndLine(FormatDepth(Room(), isBuy, price, qty, orders));
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        EndLine(FormatBook(Room(), requestId, bidLevels, askLevels));
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        EndLine(FormatBookLevel(Room(), isBuy, price, qty, orders));
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override { EndLine(FormatStats(Room(), requestId, count)); }
+    void OnStat(StatId stat, uint64_t value) override { EndLine(FormatStat(Room(), stat, value)); }
+
+private:
+    char* Room() { return _out->reserveTail(MAX_EVENT_BYTES + _suffix.size()); }
+
+    void EndLine(char* lineEnd)
+    {
+        lineEnd = PutText(lineEnd, _suffix.data(), _suffix.size());
+        *lineEnd++ = '\n';
+        _out->commit(lineEnd);
+    }
+
+    std::string _suffix;
+    ByteBuffer*& _out; // the owning worker's buffer for the current batch
+};
+
+class SymbolRouter
+{
+public:
+    // outFd < 0 throws the output away
+    SymbolRouter(size_t numWorkers, const MarketConfig& config, int outFd)
+        : _config(config)
+        , _outFd(outFd)
+        , _batches{Batch(numWorkers), Batch(numWorkers)}
+        , _bookCounts(numWorkers, 0)
+    {
+        for (size_t ii = 0; ii < numWorkers; ++ii)
+            _workers.emplace_back(std::make_unique<Worker>(ii, _config));
+    }
+
+    SymbolRouter(const SymbolRouter&) = delete;
+    SymbolRouter& operator=(const SymbolRouter&) = delete;
+
+    ~SymbolRouter()
+    {
+        for (auto& worker : _workers)
+            worker->Stop();
+    }
+
+    void Run(InputReader& reader)
+    {
+        const char* p = nullptr;
+        const char* end = nullptr;
+        bool exhausted = false;
+        Batch* inFlight = nullptr;
+        for (size_t cur = 0;; cur ^= 1)
+        {
+            Batch& batch = _batches[cur];
+            batch.Reset();
+            while (!exhausted && batch.order.size() < ROUTER_BATCH_COMMANDS)
+            {
+                if (p == end)
+                {
+                    const char* begin;
+                    if (!reader.next(begin, end))
+                    {
+                        exhausted = true;
+                        break;
+                    }
+                    p = begin;
+                }
+                Command cmd;
+                p = ParseCommand(p, end, cmd);
+                if (cmd.type == CommandType::Stop)
+                    exhausted = true;
+                else if (cmd.type != CommandType::None)
+                    Route(batch, cmd);
+                if (!p) // cmd was the last one
+                    exhausted = true;
+            }
+
+            if (inFlight)
+            {
+                for (auto& worker : _workers)
+                    worker->Wait();
+            }
+            bool haveMore = !batch.order.empty();
+            if (haveMore)
+            {
+                for (auto& worker : _workers)
+                    worker->Start(batch);
+            }
+            if (inFlight)
+                WriteOut(*inFlight);
+            if (!haveMore)
+                return;
+            inFlight = &batch;
+        }
+    }
+
+private:
+    static constexpr uint32_t NO_WORKER = UINT32_MAX; // unparseable command, answered by the router itself
+
+    struct RoutedCommand
+    {
+        Command cmd;
+        uint32_t book; // index into the worker's books
+    };
+
+    struct Batch
+    {
+        explicit Batch(size_t numWorkers)
+            : commands(numWorkers)
+            , newBooks(numWorkers)
+            , out(numWorkers)
+            , ends(numWorkers)
+        {
+        }
+
+        void Reset()
+        {
+            order.clear();
+            for (size_t ii = 0; ii < commands.size(); ++ii)
+            {
+                commands[ii].clear();
+                newBooks[ii].clear();
+            }
+        }
+
+        std::vector<uint32_t> order; // worker of each command, in input order
+        std::vector<std::vector<RoutedCommand>> commands; // per worker
+        std::vector<std::vector<std::string>> newBooks; // per worker, symbols to open books for before matching
+        std::vector<ByteBuffer> out; // per worker
+        std::vector<std::vector<size_t>> ends; // per worker, end of each of its commands' output in out
+    };
+
+    struct Book
+    {
+        Book(std::string_view symbol, ByteBuffer*& out, const MarketConfig& config)
+            : sink(symbol, out)
+            , market(sink, config)
+        {
+        }
+
+        SymbolSink sink;
+        Market market;
+    };
+
+    class Worker
+    {
+    public:
+        Worker(size_t index, const MarketConfig& config)
+            : _index(index)
+            , _config(config)
+            , _thread([this] { Loop(); })
+        {
+        }
+
+        void Start(Batch& batch)
+        {
+            _batch = &batch;
+            _start.release();
+        }
+
+        void Wait() { _done.acquire(); }
+
+        void Stop()
+        {
+            _batch = nullptr;
+            _start.release();
+            _thread.join();
+        }
+
+    private:
+        void Loop()
+        {
+            while (true)
+            {
+                _start.acquire();
+                if (!_batch)
+                    return;
+                Batch& batch = *_batch;
+                for (const std::string& symbol : batch.newBooks[_index])
+                    _books.push_back(std::make_unique<Book>(symbol, _out, _config));
+
+                _out = &batch.out[_index];
+                _out->clear();
+                std::vector<size_t>& ends = batch.ends[_index];
+                ends.clear();
+                for (const RoutedCommand& routed : batch.commands[_index])
+                {
+                    _books[routed.book]->market.Process(routed.cmd);
+                    ends.push_back(_out->size());
+                }
+                _done.release();
+            }
+        }
+
+        size_t _index;
+        const MarketConfig& _config;
+        std::vector<std::unique_ptr<Book>> _books; // only touched by this worker's thread
+        ByteBuffer* _out = nullptr;
+        Batch* _batch = nullptr;
+        std::binary_semaphore _start{0};
+        std::binary_semaphore _done{0};
+        std::thread _thread; // last, so everything it uses exists before it starts
+    };
+
+    struct Placement
+    {
+        uint32_t worker;
+        uint32_t book;
+    };
+
+    // lets _routes be searched with the string_view pointing into the input, without making a std::string
+    struct SymbolHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view symbol) const { return std::hash<std::string_view>()(symbol); }
+    };
+
+    void Route(Batch& batch, const Command& cmd)
+    {
+        if (cmd.type == CommandType::Invalid)
+        {
+            batch.order.push_back(NO_WORKER);
+            return;
+        }
+        auto it = _routes.find(cmd.symbol);
+        if (it == _routes.end())
+        {
+            uint32_t worker = uint32_t(_nextWorker++ % _workers.size());
+            it = _routes.emplace(std::string(cmd.symbol), Placement{worker, _bookCounts[worker]++}).first;
+            batch.newBooks[worker].emplace_back(cmd.symbol);
+        }
+        batch.order.push_back(it->second.worker);
+        RoutedCommand& routed = batch.commands[it->second.worker].emplace_back(RoutedCommand{cmd, it->second.book});
+        routed.cmd.symbol = std::string_view(); // the input it points into is gone by the time the worker runs
+    }
+
+    void WriteOut(Batch& batch)
+    {
+        _merged.clear();
+        std::vector<size_t> starts(_workers.size(), 0);
+        std::vector<size_t> nextCommand(_workers.size(), 0);
+        for (uint32_t worker : batch.order)
+        {
+            if (worker == NO_WORKER)
+            {
+                char* tail = _merged.reserveTail(MAX_EVENT_BYTES);
+                tail = FormatParseError(tail);
+                *tail++ = '\n';
+                _merged.commit(tail);
+                continue;
+            }
+            size_t end = batch.ends[worker][nextCommand[worker]++];
+            _merged.append(batch.out[worker].data() + starts[worker], end - starts[worker]);
+            starts[worker] = end;
+        }
+        if (_outFd >= 0)
+            WriteAll(_outFd, _merged.data(), _merged.size());
+    }
+
+    MarketConfig _config;
+    int _outFd;
+    Batch _batches[2];
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::unordered_map<std::string, Placement, SymbolHash, std::equal_to<>> _routes; // only touched by the reading thread
+    std::vector<uint32_t> _bookCounts; // per worker
+    size_t _nextWorker = 0;
+    ByteBuffer _merged;
+};
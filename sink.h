@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+#include "command.h"
+#include "stats.h"
+
+// where Market's output messages go, see the output format at the top of main.cpp
+
+// write() all of it, retrying partial writes. false (with errno set) if it couldn't, which the output
+// paths ignore as there's nowhere to report it (printf didn't either)
+inline bool WriteAll(int fd, const char* data, size_t size)
+{
+    while (size)
+    {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= size_t(written);
+    }
+    return true;
+}
+
+class EventSink
+{
+public:
+    virtual ~EventSink() = default;
+
+    virtual void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) = 0;
+    virtual void OnRevise(int32_t qty, int32_t price, uint64_t orderId) = 0;
+    virtual void OnCancel(uint64_t orderId, int32_t qty) = 0;
+    virtual void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) = 0;
+    virtual void OnParseError() = 0;
+    // an IOC, FOK or MARKET order arrived (price is 0 for MARKET). its trades follow, then a cancel of
+    // whatever didn't fill
+    virtual void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) = 0;
+
+    // aggregated depth of one level after a command changed it (only with MarketConfig::depthUpdates).
+    // qty and orders are 0 once the level is gone
+    virtual void OnDepth(bool /*isBuy*/, int32_t /*price*/, int64_t /*qty*/, uint32_t /*orders*/) {}
+    // answer to a DEPTH request: this, then bidLevels + askLevels OnBookLevel calls, bids first, best first
+    virtual void OnBook(uint64_t /*requestId*/, uint32_t /*bidLevels*/, uint32_t /*askLevels*/) {}
+    virtual void OnBookLevel(bool /*isBuy*/, int32_t /*price*/, int64_t /*qty*/, uint32_t /*orders*/) {}
+    // answer to a STATS request: this, then count OnStat calls in StatId order
+    virtual void OnStats(uint64_t /*requestId*/, uint32_t /*count*/) {}
+    virtual void OnStat(StatId /*stat*/, uint64_t /*value*/) {}
+
+    // called at the end of each batch of input, and before exit
+    virtual void Flush() {}
+};
+
+// drops everything, for benchmarking the matching on its own. final, so a NullMarket's calls compile away
+class NullSink final : public EventSink
+{
+public:
+    void OnOrder(bool, int32_t, int32_t, uint64_t) override {}
+    void OnRevise(int32_t, int32_t, uint64_t) override {}
+    void OnCancel(uint64_t, int32_t) override {}
+    void OnTrade(uint64_t, uint64_t, int32_t, int32_t) override {}
+    void OnParseError() override {}
+    void OnImmediate(ImmediateKind, bool, int32_t, int32_t, uint64_t) override {}
+};
+
+constexpr size_t OUTPUT_BUFFER_BYTES = 64 * 1024;
+constexpr size_t MAX_EVENT_BYTES = 128; // longest line is a TRADE, 6 + 20 + 1 + 20 + 1 + 11 + 1 + 11 + 1
+
+// the text protocol's output messages. each one writes a line without its newline, into a buffer with at
+// least MAX_EVENT_BYTES of room, and returns where it ended. byte for byte what the old printf calls produced
+
+inline char* PutText(char* out, const char* str, size_t len)
+{
+    std::memcpy(out, str, len);
+    return out + len;
+}
+
+template <typename Int>
+char* PutNumber(char* out, Int value)
+{
+    return std::to_chars(out, out + 20, value).ptr; // 20 digits is the longest uint64_t, and int32_t with its sign
+}
+
+inline char* FormatOrder(char* out, bool isBuy, int32_t qty, int32_t price, uint64_t orderId)
+{
+    out = isBuy ? PutText(out, "BUY ", 4) : PutText(out, "SELL ", 5);
+    out = PutNumber(out, qty);
+    *out++ = ' ';
+    out = PutNumber(out, price);
+    *out++ = ' ';
+    return PutNumber(out, orderId);
+}
+
+inline char* FormatRevise(char* out, int32_t qty, int32_t price, uint64_t orderId)
+{
+    out = PutText(out, "REVISE ", 7);
+    out = PutNumber(out, qty);
+    *out++ = ' ';
+    out = PutNumber(out, price);
+    *out++ = ' ';
+    return PutNumber(out, orderId);
+}
+
+inline char* FormatCancel(char* out, uint64_t orderId, int32_t qty)
+{
+    out = PutText(out, "CANCEL ", 7);
+    out = PutNumber(out, orderId);
+    *out++ = ' ';
+    return PutNumber(out, qty);
+}
+
+inline char* FormatTrade(char* out, uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price)
+{
+    out = PutText(out, "TRADE ", 6);
+    out = PutNumber(out, aggressorId);
+    *out++ = ' ';
+    out = PutNumber(out, passiveId);
+    *out++ = ' ';
+    out = PutNumber(out, qty);
+    *out++ = ' ';
+    return PutNumber(out, price);
+}
+
+inline char* FormatParseError(char* out) { return PutText(out, "could not parse command", 23); }
+
+inline char* FormatImmediate(char* out, ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId)
+{
+    switch (kind)
+    {
+    case ImmediateKind::Ioc:
+        out = PutText(out, "IOC ", 4);
+        break;
+    case ImmediateKind::Fok:
+        out = PutText(out, "FOK ", 4);
+        break;
+    case ImmediateKind::Market:
+        out = PutText(out, "MARKET ", 7);
+        break;
+    }
+    out = isBuy ? PutText(out, "BUY ", 4) : PutText(out, "SELL ", 5);
+    out = PutNumber(out, qty);
+    *out++ = ' ';
+    if (kind != ImmediateKind::Market)
+    {
+        out = PutNumber(out, price);
+        *out++ = ' ';
+    }
+    return PutNumber(out, orderId);
+}
+
+// the rest of a DEPTH or LEVEL line
+inline char* FormatLevel(char* out, bool isBuy, int32_t price, int64_t qty, uint32_t orders)
+{
+    out = isBuy ? PutText(out, "BID ", 4) : PutText(out, "ASK ", 4);
+    out = PutNumber(out, price);
+    *out++ = ' ';
+    out = PutNumber(out, qty);
+    *out++ = ' ';
+    return PutNumber(out, orders);
+}
+
+inline char* FormatDepth(char* out, bool isBuy, int32_t price, int64_t qty, uint32_t orders)
+{
+    return FormatLevel(PutText(out, "DEPTH ", 6), isBuy, price, qty, orders);
+}
+
+inline char* FormatBook(char* out, uint64_t requestId, uint32_t bidLevels, uint32_t askLevels)
+{
+    out = PutText(out, "BOOK ", 5);
+    out = PutNumber(out, requestId);
+    *out++ = ' ';
+    out = PutNumber(out, bidLevels);
+    *out++ = ' ';
+    return PutNumber(out, askLevels);
+}
+
+inline char* FormatBookLevel(char* out, bool isBuy, int32_t price, int64_t qty, uint32_t orders)
+{
+    return FormatLevel(PutText(out, "LEVEL ", 6), isBuy, price, qty, orders);
+}
+
+inline char* FormatStats(char* out, uint64_t requestId, uint32_t count)
+{
+    out = PutText(out, "STATS ", 6);
+    out = PutNumber(out, requestId);
+    *out++ = ' ';
+    return PutNumber(out, count);
+}
+
+inline char* FormatStat(char* out, StatId stat, uint64_t value)
+{
+    std::string_view name = StatName(stat);
+    out = PutText(out, "STAT ", 5);
+    out = PutText(out, name.data(), name.size());
+    *out++ = ' ';
+    return PutNumber(out, value);
+}
+
+// the text protocol into one reusable buffer which goes out in a single write() when it's full or at the
+// end of a batch
+class BufferedSink : public EventSink
+{
+public:
+    explicit BufferedSink(int fd, size_t capacity = OUTPUT_BUFFER_BYTES)
+        : _fd(fd)
+        , _buffer(std::max(capacity, MAX_EVENT_BYTES))
+        , _pos(_buffer.data())
+        , _end(_buffer.data() + _buffer.size())
+    {
+    }
+
+    BufferedSink(const BufferedSink&) = delete;
+    BufferedSink& operator=(const BufferedSink&) = delete;
+
+    ~BufferedSink() override { Flush(); }
+
+    void OnOrder(bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        MakeRoom();
+        EndLine(FormatOrder(_pos, isBuy, qty, price, orderId));
+    }
+
+    void OnRevise(int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        MakeRoom();
+        EndLine(FormatRevise(_pos, qty, price, orderId));
+    }
+
+    void OnCancel(uint64_t orderId, int32_t qty) override
+    {
+        MakeRoom();
+        EndLine(FormatCancel(_pos, orderId, qty));
+    }
+
+    void OnTrade(uint64_t aggressorId, uint64_t passiveId, int32_t qty, int32_t price) override
+    {
+        MakeRoom();
+        EndLine(FormatTrade(_pos, aggressorId, passiveId, qty, price));
+    }
+
+    void OnParseError() override
+    {
+        MakeRoom();
+        EndLine(FormatParseError(_pos));
+    }
+
+    void OnImmediate(ImmediateKind kind, bool isBuy, int32_t qty, int32_t price, uint64_t orderId) override
+    {
+        MakeRoom();
+        EndLine(FormatImmediate(_pos, kind, isBuy, qty, price, orderId));
+    }
+
+    void OnDepth(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        MakeRoom();
+        EndLine(FormatDepth(_pos, isBuy, price, qty, orders));
+    }
+
+    void OnBook(uint64_t requestId, uint32_t bidLevels, uint32_t askLevels) override
+    {
+        MakeRoom();
+        EndLine(FormatBook(_pos, requestId, bidLevels, askLevels));
+    }
+
+    void OnBookLevel(bool isBuy, int32_t price, int64_t qty, uint32_t orders) override
+    {
+        MakeRoom();
+        EndLine(FormatBookLevel(_pos, isBuy, price, qty, orders));
+    }
+
+    void OnStats(uint64_t requestId, uint32_t count) override
+    {
+        MakeRoom();
+        EndLine(FormatStats(_pos, requestId, count));
+    }
+
+    void OnStat(StatId stat, uint64_t value) override
+    {
+        MakeRoom();
+        EndLine(FormatStat(_pos, stat, value));
+    }
+
+    void Flush() override
+    {
+        WriteAll(_fd, _buffer.data(), size_t(_pos - _buffer.data()));
+        _pos = _buffer.data();
+    }
+
+private:
+    void MakeRoom()
+    {
+        if (size_t(_end - _pos) < MAX_EVENT_BYTES)
+            Flush();
+    }
+
+    void EndLine(char* lineEnd)
+    {
+        *lineEnd++ = '\n';
+        _pos = lineEnd;
+    }
+
+    int _fd;
+    std::vector<char> _buffer;
+    char* _pos;
+    char* _end;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "market.h"
+#include "reader.h"
+#include "sink.h"
+
+// book snapshots, so a restarted trade can pick up where it stopped instead of replaying the whole day.
+// a snapshot is a SnapshotHeader followed by one SnapshotOrder per resting order, each level's orders
+// back to back in queue order, so restoring them in file order rebuilds every queue as it was. the id index
+// is rebuilt from the orders' indexed flags. the header records how many commands had been processed and
+// how far into the input they went, and the restore skips the input to that offset.
+// same layout rules as protocol.h: little-endian, naturally aligned, written as it is in memory.
+
+constexpr char SNAPSHOT_MAGIC[4] = {'W', 'J', 'S', 'N'};
+constexpr uint16_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t recordSize; // sizeof(SnapshotOrder)
+    uint32_t reserved2;
+    uint64_t sequence; // commands processed, including unparseable ones
+    uint64_t inputOffset; // bytes of input they were read from
+    uint64_t orderCount;
+};
+static_assert(sizeof(SnapshotHeader) == 40);
+
+struct SnapshotOrder
+{
+    uint64_t orderId;
+    int32_t price;
+    int32_t qty;
+    uint8_t isBuy;
+    uint8_t indexed; // 0 if a later order with the same id took over the id
+    uint8_t pad[6];
+};
+static_assert(sizeof(SnapshotOrder) == 24);
+
+struct SnapshotPosition
+{
+    uint64_t sequence = 0;
+    uint64_t inputOffset = 0;
+};
+
+// set by SIGUSR2, main takes a snapshot at the next batch boundary
+inline volatile std::sig_atomic_t snapshotRequested = 0;
+
+inline void RequestSnapshot(int) { snapshotRequested = 1; }
+
+// writes to path.tmp, syncs it and renames it over path, so a crash mid-write leaves the previous snapshot
+// alone, then syncs the directory so the rename itself survives one. false (with errno set) if any of that
+// failed. if it was the write, path.tmp is removed and path is untouched
+inline bool WriteSnapshot(Market& market, const std::string& path, const SnapshotPosition& position)
+{
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    std::vector<SnapshotOrder> orders;
+    market.ForEachOrder([&](bool isBuy, const Order& order, bool indexed)
+                        {
+                            SnapshotOrder& record = orders.emplace_back();
+                            record.orderId = order.orderId;
+                            record.price = order.price;
+                            record.qty = order.qty;
+                            record.isBuy = isBuy;
+                            record.indexed = indexed;
+                        });
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.recordSize = sizeof(SnapshotOrder);
+    header.sequence = position.sequence;
+    header.inputOffset = position.inputOffset;
+    header.orderCount = orders.size();
+
+    bool ok = WriteAll(fd, reinterpret_cast<const char*>(&header), sizeof(header))
+        && WriteAll(fd, reinterpret_cast<const char*>(orders.data()), orders.size() * sizeof(SnapshotOrder))
+        && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok)
+    {
+        // a short file must never replace the good one. unlink may clobber errno, keep the write's
+        int error = errno;
+        unlink(tmpPath.c_str());
+        errno = error;
+        return false;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+        return false;
+    // and the new name in the directory, or a crash can still bring back the previous snapshot
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd < 0)
+        return false;
+    ok = fsync(dirFd) == 0;
+    int error = errno;
+    close(dirFd);
+    errno = error;
+    return ok;
+}
+
+// rebuilds a book from a snapshot into an empty market. the file is mapped and the orders are placed
+// straight into their levels, without matching or output. false (with a message on stderr) if it isn't
+// a complete version SNAPSHOT_VERSION snapshot
+inline bool LoadSnapshot(Market& market, const std::string& path, SnapshotPosition& position)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path.c_str());
+        return false;
+    }
+    InputReader reader(fd);
+    SnapshotHeader header;
+    if (!reader.take(&header, sizeof(header)) || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SNAPSHOT_VERSION || header.recordSize != sizeof(SnapshotOrder))
+    {
+        fprintf(stderr, "%s: not a version %u snapshot\n", path.c_str(), unsigned(SNAPSHOT_VERSION));
+        close(fd);
+        return false;
+    }
+
+    // the count is checked against the file before anything is sized by it, a corrupt one would ask for any amount
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(SnapshotHeader))
+        || (uint64_t(st.st_size) - sizeof(SnapshotHeader)) % sizeof(SnapshotOrder) != 0
+        || (uint64_t(st.st_size) - sizeof(SnapshotHeader)) / sizeof(SnapshotOrder) != header.orderCount)
+    {
+        fprintf(stderr, "%s: header says %llu orders, the file's size doesn't\n", path.c_str(),
+                (unsigned long long)header.orderCount);
+        close(fd);
+        return false;
+    }
+    market.Reserve(header.orderCount);
+    uint64_t restored = 0;
+    const char* begin;
+    const char* end;
+    while (reader.nextRecords(begin, end, sizeof(SnapshotOrder)))
+    {
+        for (const char* p = begin; p + sizeof(SnapshotOrder) <= end; p += sizeof(SnapshotOrder))
+        {
+            SnapshotOrder record;
+            std::memcpy(&record, p, sizeof(record));
+            market.RestoreOrder(record.orderId, record.isBuy, record.qty, record.price, record.indexed);
+            ++restored;
+        }
+    }
+    close(fd);
+    if (restored != header.orderCount)
+    {
+        fprintf(stderr, "%s: truncated, %llu of %llu orders\n", path.c_str(), (unsigned long long)restored,
+                (unsigned long long)header.orderCount);
+        return false;
+    }
+    position.sequence = header.sequence;
+    position.inputOffset = header.inputOffset;
+    return true;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+// bounded lock-free single-producer/single-consumer ring. head and tail each sit on their own cache line
+// next to the owning side's cached copy of the other index, so in the steady state neither side touches
+// the other's line except to refresh that copy when the ring looks full or empty.
+
+constexpr size_t CACHE_LINE_BYTES = 64;
+
+enum class BackOff
+{
+    Spin, // never sleeps, lowest latency, burns its core
+    Block, // spins briefly, then sleeps in std::atomic::wait until the other side moves
+};
+
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// pins the calling thread to one cpu, cpu < 0 leaves it alone. false if the kernel refused
+inline bool PinThisThread(int cpu)
+{
+    if (cpu < 0)
+        return true;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+template <typename T>
+class SpscRing
+{
+public:
+    // capacity is rounded up to a power of two
+    SpscRing(size_t capacity, BackOff backOff)
+        : _backOff(backOff)
+    {
+        size_t rounded = 1;
+        while (rounded < capacity)
+            rounded *= 2;
+        _mask = rounded - 1;
+        _slots = std::make_unique<T[]>(rounded);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // producer side
+    bool tryPush(const T& item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead > _mask)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead > _mask)
+                return false;
+        }
+        _slots[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        if (_backOff == BackOff::Block)
+            _tail.notify_one();
+        return true;
+    }
+
+    void push(const T& item)
+    {
+        for (unsigned spins = 0; !tryPush(item); ++spins)
+            Pause(_head, _cachedHead, spins);
+    }
+
+    // consumer side
+    bool tryPop(T& item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail)
+                return false;
+        }
+        item = _slots[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        if (_backOff == BackOff::Block)
+            _head.notify_one();
+        return true;
+    }
+
+    void pop(T& item)
+    {
+        for (unsigned spins = 0; !tryPop(item); ++spins)
+            Pause(_tail, _cachedTail, spins);
+    }
+
+private:
+    static constexpr unsigned SPINS_BEFORE_YIELD = 1024; // lets a Spin ring make progress on an oversubscribed box
+    static constexpr unsigned SPINS_BEFORE_SLEEP = 64;
+
+    // waits for the other side's index to move on from what we last saw of it
+    void Pause(const std::atomic<size_t>& index, size_t seen, unsigned spins)
+    {
+        if (_backOff == BackOff::Block && spins >= SPINS_BEFORE_SLEEP)
+            index.wait(seen, std::memory_order_acquire);
+        else if (spins % SPINS_BEFORE_YIELD == SPINS_BEFORE_YIELD - 1)
+            std::this_thread::yield();
+        else
+            CpuRelax();
+    }
+
+    // consumer's line
+    alignas(CACHE_LINE_BYTES) std::atomic<size_t> _head{0};
+    size_t _cachedTail = 0;
+    // producer's line
+    alignas(CACHE_LINE_BYTES) std::atomic<size_t> _tail{0};
+    size_t _cachedHead = 0;
+    // read only after construction
+    alignas(CACHE_LINE_BYTES) std::unique_ptr<T[]> _slots;
+    size_t _mask;
+    BackOff _backOff;
+};
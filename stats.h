@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+// what a Market has done and how big it has grown. the counters are bumped on the matching path as plain
+// increments, everything else is read off the book and its allocators when asked for, which is a STATS
+// command (answered with a STATS line and then a STAT line per value, see main.cpp) or a StatsBoard
+// publish for the --stats-file dumper.
+
+enum class StatId : uint8_t
+{
+    Commands, // every command the Market was handed, including DEPTH, STATS and unparseable ones
+    Orders, // BUY and SELL
+    Revises,
+    Cancels,
+    Immediates, // IOC, FOK and MARKET
+    Trades,
+    UnknownCancels, // of ids which weren't resting, which do nothing
+    UnknownRevises,
+    RestingOrders,
+    PeakRestingOrders,
+    BidLevels,
+    AskLevels,
+    PeakBidLevels,
+    PeakAskLevels,
+    PoolAllocs, // calls into the Market's SlabPool, through PoolAllocator or directly
+    PoolFrees,
+    PoolBytesInUse, // handed out and not given back, rounded up to the size class
+    PoolBytesReserved, // chunks taken from the system, which the pool never gives back
+    PoolChunks,
+    IndexBytes, // the id index's slot array
+    LadderBytes, // both sides' flat level arrays and bitmaps. out-of-band levels are in the pool's bytes
+    MemoryBytes, // pool reserved, its big blocks, the index and the ladders
+};
+
+constexpr size_t NUM_STATS = size_t(StatId::MemoryBytes) + 1;
+
+constexpr std::string_view STAT_NAMES[NUM_STATS] = {
+    "commands", "orders", "revises", "cancels", "immediates", "trades", "unknown_cancels", "unknown_revises",
+    "resting_orders", "peak_resting_orders", "bid_levels", "ask_levels", "peak_bid_levels", "peak_ask_levels",
+    "pool_allocs", "pool_frees", "pool_bytes_in_use", "pool_bytes_reserved", "pool_chunks", "index_bytes",
+    "ladder_bytes", "memory_bytes"};
+
+inline std::string_view StatName(StatId stat) { return STAT_NAMES[size_t(stat)]; }
+
+// false if name isn't one of STAT_NAMES
+inline bool ParseStatName(std::string_view name, StatId& stat)
+{
+    auto it = std::find(std::begin(STAT_NAMES), std::end(STAT_NAMES), name);
+    stat = StatId(it - std::begin(STAT_NAMES));
+    return it != std::end(STAT_NAMES);
+}
+
+struct MarketStats
+{
+    uint64_t& operator[](StatId stat) { return values[size_t(stat)]; }
+    uint64_t operator[](StatId stat) const { return values[size_t(stat)]; }
+
+    uint64_t values[NUM_STATS] = {};
+};
+
+// the part of MarketStats the Market has to count as it goes, the book can't tell it afterwards
+struct MarketCounters
+{
+    // after anything which can grow the book
+    void NoteBookSize(bool isBuy, size_t orders, size_t levels)
+    {
+        peakRestingOrders = std::max<uint64_t>(peakRestingOrders, orders);
+        uint64_t& peakLevels = isBuy ? peakBidLevels : peakAskLevels;
+        peakLevels = std::max<uint64_t>(peakLevels, levels);
+    }
+
+    uint64_t commands = 0;
+    uint64_t orders = 0;
+    uint64_t revises = 0;
+    uint64_t cancels = 0;
+    uint64_t immediates = 0;
+    uint64_t trades = 0;
+    uint64_t unknownCancels = 0;
+    uint64_t unknownRevises = 0;
+    uint64_t peakRestingOrders = 0;
+    uint64_t peakBidLevels = 0;
+    uint64_t peakAskLevels = 0;
+};
+
+// the latest MarketStats, handed from the matching thread to any number of readers without a lock. it's
+// a seqlock: the writer bumps the sequence to odd, stores, and bumps it back to even, and a reader retries
+// until it sees the same even sequence before and after its loads. so Publish never waits on anyone
+class StatsBoard
+{
+public:
+    // only ever called from one thread at a time
+    void Publish(const MarketStats& stats)
+    {
+        uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t ii = 0; ii < NUM_STATS; ++ii)
+            _values[ii].store(stats.values[ii], std::memory_order_relaxed);
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // all zero until the first Publish
+    MarketStats Read() const
+    {
+        MarketStats stats;
+        while (true)
+        {
+            uint64_t before = _sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                std::this_thread::yield(); // a Publish is halfway, it'll be done in a moment
+                continue;
+            }
+            for (size_t ii = 0; ii < NUM_STATS; ++ii)
+                stats.values[ii] = _values[ii].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequence.load(std::memory_order_relaxed) == before)
+                return stats;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> _sequence{0};
+    std::atomic<uint64_t> _values[NUM_STATS] = {};
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sink.h"
+#include "stats.h"
+
+// --stats-file: a thread of its own which every interval reads the StatsBoard the matching thread publishes
+// to and rewrites the file with it, in the same STATS and STAT lines a STATS command gets (the request id
+// is the dump's number, counting from 1). the file is written next to itself and renamed over, so a reader
+// never sees half of one. the matching thread only ever does the seqlock Publish, never a write()
+
+class StatsDumper
+{
+public:
+    StatsDumper(const std::string& path, std::chrono::milliseconds interval, const StatsBoard& board)
+        : _path(path)
+        , _interval(interval)
+        , _board(board)
+        , _thread([this] { Loop(); })
+    {
+    }
+
+    StatsDumper(const StatsDumper&) = delete;
+    StatsDumper& operator=(const StatsDumper&) = delete;
+
+    // with one last dump, of whatever was published last
+    ~StatsDumper()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stop = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+        Dump();
+    }
+
+private:
+    void Loop()
+    {
+        std::unique_lock<std::mutex> guard(_lock); // only shared with the destructor
+        while (!_wake.wait_for(guard, _interval, [this] { return _stop; }))
+            Dump();
+    }
+
+    void Dump()
+    {
+        MarketStats stats = _board.Read();
+        std::string tempPath = _path + ".tmp";
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            perror(tempPath.c_str());
+            return;
+        }
+        {
+            BufferedSink sink(fd);
+            sink.OnStats(++_dumps, uint32_t(NUM_STATS));
+            for (size_t ii = 0; ii < NUM_STATS; ++ii)
+                sink.OnStat(StatId(ii), stats.values[ii]);
+        }
+        close(fd);
+        if (rename(tempPath.c_str(), _path.c_str()) != 0)
+            perror(_path.c_str());
+    }
+
+    std::string _path;
+    std::chrono::milliseconds _interval;
+    const StatsBoard& _board;
+    uint64_t _dumps = 0;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    bool _stop = false;
+    std::thread _thread; // last, so everything it uses exists before it starts
+};
@@ -6,6 +6,9 @@
 #include <cstdio>
 #include <memory>
 
+#include "darray.h"
+#include "pool.h"
+
 constexpr std::size_t POOL_SIZE = 1024 * 1024;
 
 class MemoryPool
@@ -120,5 +123,33 @@ int main()
 
         GetSharedPool().reset();
     }
+
+    // the recycling SlabPool from pool.h gets blocks back on deallocate, so after the first iteration
+    // the vectors are served from its free lists and the chunk count stays put
+    SlabPool slabPool;
+    for (int ii = 0; ii < 5; ++ii)
+    {
+        PoolAllocator<int> alloc(&slabPool);
+        std::vector<int, PoolAllocator<int>> stdVec(alloc);
+        bear::vector<int, PoolAllocator<int>> bearVec(alloc);
+        for (int jj = 0; jj < 100; ++jj)
+        {
+            stdVec.push_back(jj * ii);
+            bearVec.push_back(jj * ii);
+        }
+        printf("SlabPool iteration #%d: %zu chunks, %zu bytes reserved, %zu in use, %llu allocs, %llu frees\n", ii,
+               slabPool.chunkCount(), slabPool.bytesReserved(), slabPool.bytesInUse(),
+               (unsigned long long)slabPool.allocCount(), (unsigned long long)slabPool.freeCount());
+    }
+
+    // polymorphic_allocator doesn't propagate, so each vector keeps its own resource through assignments
+    SlabResource otherResource;
+    bear::vector<int, std::pmr::polymorphic_allocator<int>> threadVec({1, 2, 3}, &ThreadSlabResource());
+    bear::vector<int, std::pmr::polymorphic_allocator<int>> otherVec(&otherResource);
+    otherVec = threadVec;
+    otherVec.push_back(4);
+    threadVec = std::move(otherVec);
+    printf("pmr: %zu ints, still on the thread's resource: %d, other resource %zu chunks\n", threadVec.size(),
+           threadVec.get_allocator().resource() == &ThreadSlabResource(), otherResource.pool().chunkCount());
     return 0;
 }